@@ -0,0 +1,68 @@
+// bench/bench_cmdcache.c
+//
+// Cost of turning a repeated line into a runnable command list.
+// usage: bench_cmdcache [iterations]
+// Times parse_input + alias_expand + command path lookup + command_list_free
+// for every line, which is what each line used to cost, then
+// cmdcache_get + cmdcache_release on the same lines.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "alias.h"
+#include "cmdcache.h"
+#include "cmdhash.h"
+#include "parser.h"
+
+static const char *lines[] = {
+    "ll /tmp",
+    "nmap -sV -p 1-65535 -T4 10.0.0.1 > scan.txt",
+    "cat < targets.txt | grep -v '#' | sort | uniq -c | sort -rn > counts.txt",
+    "gobuster dir -u http://10.0.0.5 -w /usr/share/wordlists/dirb/common.txt -t 50 >> gobuster.log",
+    "tail -n 1000 access.log | cut -d ' ' -f 1 | sort | uniq",
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    if (iterations < 1) iterations = 1;
+    size_t nlines = sizeof(lines) / sizeof(lines[0]);
+    alias_set("ll", "ls -la", 0);
+
+    volatile size_t sink = 0;
+    double start = now_sec();
+    for (long i = 0; i < iterations; i++) {
+        command_list_t *cmdlist = parse_input(lines[i % nlines]);
+        alias_expand(cmdlist);
+        const pipeline_t *p = cmdlist->pipelines[0];
+        for (size_t j = 0; j < p->count; j++) {
+            const char *path = cmdhash_lookup(p->commands[j]->argv[0]);
+            sink += path != NULL;
+        }
+        command_list_free(cmdlist);
+    }
+    double parsed = (now_sec() - start) / iterations;
+
+    start = now_sec();
+    for (long i = 0; i < iterations; i++) {
+        command_list_t *cmdlist = cmdcache_get(lines[i % nlines]);
+        sink += cmdlist->pipeline_count;
+        cmdcache_release(cmdlist);
+    }
+    double cached = (now_sec() - start) / iterations;
+
+    printf("lines: %zu, iterations: %ld\n", nlines, iterations);
+    printf("parsed: %8.1f ns/line\n", parsed * 1e9);
+    printf("cached: %8.1f ns/line\n", cached * 1e9);
+    cmdcache_free();
+    alias_free();
+    return 0;
+}
@@ -0,0 +1,98 @@
+// bench/bench_copy.c
+//
+// Throughput of cat stages with and without the in-process data pump.
+// usage: bench_copy [MiB] [runs]
+// Runs `cat < src > dst` (file to file), `cat src | cat > dst` (file to
+// pipe to file) and `cat src | tee dst2 > dst` (fan-out) through the
+// executor with `zerocopy` on and off. The best
+// run is reported; dst is unlinked first so truncating it costs nothing.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "parser.h"
+#include "executor.h"
+#include "options.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(const char *line, const char *dst, int runs) {
+    command_list_t *cmdlist = parse_input(line);
+    if (!cmdlist || cmdlist->pipeline_count == 0) {
+        fprintf(stderr, "parse error: %s\n", line);
+        exit(EXIT_FAILURE);
+    }
+    double best = 0;
+    for (int i = 0; i < runs; i++) {
+        unlink(dst);
+        double start = now_sec();
+        if (executor_execute(cmdlist->pipelines[0]->commands[0], 0) != 0) {
+            fprintf(stderr, "failed: %s\n", line);
+            exit(EXIT_FAILURE);
+        }
+        double elapsed = now_sec() - start;
+        if (i == 0 || elapsed < best) best = elapsed;
+    }
+    command_list_free(cmdlist);
+    return best;
+}
+
+int main(int argc, char **argv) {
+    long mib = argc > 1 ? atol(argv[1]) : 512;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    if (mib < 1) mib = 1;
+    if (runs < 1) runs = 1;
+
+    char src[] = "/tmp/kali_bench_copyXXXXXX";
+    int fd = mkstemp(src);
+    if (fd == -1) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    char *block = malloc(1 << 20);
+    if (!block) return EXIT_FAILURE;
+    for (size_t i = 0; i < (1 << 20); i++) block[i] = (char)(i * 2654435761u >> 24);
+    for (long i = 0; i < mib; i++) {
+        if (write(fd, block, 1 << 20) != 1 << 20) {
+            perror("write");
+            return EXIT_FAILURE;
+        }
+    }
+    close(fd);
+    free(block);
+
+    char dst[sizeof(src) + 4];
+    snprintf(dst, sizeof(dst), "%s.out", src);
+
+    char file_file[128], file_pipe[128], fanout[160];
+    snprintf(file_file, sizeof(file_file), "cat < %s > %s", src, dst);
+    snprintf(file_pipe, sizeof(file_pipe), "cat %s | cat > %s", src, dst);
+    snprintf(fanout, sizeof(fanout), "cat %s | tee %s.2 > %s", src, dst, dst);
+
+    printf("size: %ld MiB, runs: %d\n", mib, runs);
+    const char *lines[] = { file_file, file_pipe, fanout };
+    const char *names[] = { "file -> file", "file -> pipe -> file", "file -> tee -> 2 files" };
+    for (int i = 0; i < 3; i++) {
+        option_set("zerocopy", 0);
+        double forked = run(lines[i], dst, runs);
+        option_set("zerocopy", 1);
+        double pumped = run(lines[i], dst, runs);
+        printf("%-24s forked: %8.1f MiB/s   pump: %8.1f MiB/s\n", names[i], mib / forked, mib / pumped);
+    }
+
+    unlink(src);
+    unlink(dst);
+    char dst2[sizeof(dst) + 2];
+    snprintf(dst2, sizeof(dst2), "%s.2", dst);
+    unlink(dst2);
+    return 0;
+}
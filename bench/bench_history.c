@@ -0,0 +1,87 @@
+// bench/bench_history.c
+//
+// History startup time on large history files.
+// usage: bench_history [lines] [histsize]
+// Compares a getline+strdup read of the whole file with history_init on a
+// cold sidecar index (first run, full scan) and a warm one.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "history.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The old loader: one getline + strdup per line
+static double getline_load(const char *path) {
+    double start = now_sec();
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+    char *line = NULL;
+    size_t len = 0, count = 0, cap = 1024;
+    char **lines = malloc(cap * sizeof(char *));
+    while (getline(&line, &len, fp) != -1) {
+        if (count == cap) lines = realloc(lines, (cap *= 2) * sizeof(char *));
+        lines[count++] = strdup(line);
+    }
+    double elapsed = now_sec() - start;
+    for (size_t i = 0; i < count; i++) free(lines[i]);
+    free(lines);
+    free(line);
+    fclose(fp);
+    return elapsed;
+}
+
+static double timed_init(const char *path, size_t histsize) {
+    double start = now_sec();
+    history_init(path, histsize, 1);
+    double elapsed = now_sec() - start;
+    return elapsed;
+}
+
+int main(int argc, char **argv) {
+    long lines = argc > 1 ? atol(argv[1]) : 1000000;
+    size_t histsize = argc > 2 ? (size_t)atol(argv[2]) : 1000;
+
+    char path[] = "/tmp/kali_bench_historyXXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    FILE *fp = fdopen(fd, "w");
+    for (long i = 0; i < lines; i++)
+        fprintf(fp, "nmap -sV -p- 10.0.%ld.%ld -oN scan_%ld.txt\n", (i >> 8) & 255, i & 255, i);
+    fclose(fp);
+
+    char idx[sizeof(path) + 8];
+    snprintf(idx, sizeof(idx), "%s.idx", path);
+    unlink(idx);
+
+    printf("lines: %ld, histsize: %zu\n", lines, histsize);
+    printf("getline+strdup:      %8.3f ms\n", getline_load(path) * 1e3);
+
+    printf("history_init cold:   %8.3f ms\n", timed_init(path, histsize) * 1e3);
+    history_free();
+
+    printf("history_init warm:   %8.3f ms\n", timed_init(path, histsize) * 1e3);
+
+    double start = now_sec();
+    size_t n = history_len(), bytes = 0;
+    for (size_t i = 0; i < n; i++) bytes += strlen(history_at(i));
+    printf("touch %zu entries: %8.3f ms (%zu bytes)\n", n, (now_sec() - start) * 1e3, bytes);
+    history_free();
+
+    unlink(path);
+    unlink(idx);
+    return 0;
+}
@@ -0,0 +1,75 @@
+// bench/bench_parallel.c
+//
+// Job throughput of the parallel stage against a loop of executor calls.
+// usage: bench_parallel [jobs] [workers] [command]
+// Runs `command 0` jobs times, first one executor_execute at a time as a
+// script loop would, then as `parallel -j workers command ::: 0 0 ...`, and
+// reports jobs per second for each. workers defaults to the CPU count; try
+// "sleep 0.01" as the command for jobs that mostly wait.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "parser.h"
+#include "executor.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run_line(const char *line) {
+    command_list_t *cmdlist = parse_input(line);
+    if (!cmdlist || cmdlist->pipeline_count == 0) {
+        fprintf(stderr, "parse error: %s\n", line);
+        return -1;
+    }
+    int status = executor_execute(cmdlist->pipelines[0]->commands[0], 0);
+    command_list_free(cmdlist);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    int jobs = argc > 1 ? atoi(argv[1]) : 2000;
+    long workers = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    const char *command = argc > 3 ? argv[3] : "true";
+    if (jobs < 1) jobs = 1;
+    if (workers < 1) workers = 1;
+
+    char one[256];
+    snprintf(one, sizeof(one), "%s 0", command);
+    double start = now_sec();
+    for (int i = 0; i < jobs; i++) {
+        if (run_line(one) != 0) {
+            fprintf(stderr, "command failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    double loop = now_sec() - start;
+
+    size_t cap = 64 + strlen(command) + (size_t)jobs * 2;
+    char *line = malloc(cap);
+    if (!line) return EXIT_FAILURE;
+    size_t used = (size_t)snprintf(line, cap, "parallel -j %ld %s :::", workers, command);
+    for (int i = 0; i < jobs; i++)
+        used += (size_t)snprintf(line + used, cap - used, " 0");
+
+    start = now_sec();
+    if (run_line(line) != 0) {
+        fprintf(stderr, "parallel failed\n");
+        return EXIT_FAILURE;
+    }
+    double par = now_sec() - start;
+
+    printf("jobs: %d, workers: %ld, command: %s\n", jobs, workers, command);
+    printf("executor loop: %8.0f jobs/s\n", jobs / loop);
+    printf("parallel:      %8.0f jobs/s\n", jobs / par);
+    free(line);
+    return 0;
+}
@@ -0,0 +1,45 @@
+// bench/bench_parse.c
+//
+// Parse throughput: parse_input + command_list_free, in lines/sec.
+// usage: bench_parse [iterations]
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "parser.h"
+
+static const char *lines[] = {
+    "ls -la",
+    "nmap -sV -p 1-65535 -T4 10.0.0.1 > scan.txt",
+    "cat < targets.txt | grep -v '#' | sort | uniq -c | sort -rn > counts.txt",
+    "gobuster dir -u http://10.0.0.5 -w /usr/share/wordlists/dirb/common.txt -t 50 >> gobuster.log",
+    "tail -n 1000 access.log | cut -d ' ' -f 1 | sort | uniq",
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    size_t nlines = sizeof(lines) / sizeof(lines[0]);
+
+    double start = now_sec();
+    for (long i = 0; i < iterations; i++) {
+        command_list_t *cmdlist = parse_input(lines[i % nlines]);
+        if (!cmdlist) {
+            fprintf(stderr, "parse error: %s\n", lines[i % nlines]);
+            return EXIT_FAILURE;
+        }
+        command_list_free(cmdlist);
+    }
+    double elapsed = now_sec() - start;
+
+    printf("parsed %ld lines in %.3f s: %.0f lines/sec\n", iterations, elapsed, iterations / elapsed);
+    return 0;
+}
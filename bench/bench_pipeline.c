@@ -0,0 +1,75 @@
+// bench/bench_pipeline.c
+//
+// Wall time of long pipelines run through the executor.
+// usage: bench_pipeline [stages] [runs]
+// Runs `true < /dev/null | cat | ... | cat > /dev/null` and reports the mean
+// launch-to-reap time next to /bin/sh -c running the same line.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "parser.h"
+#include "executor.h"
+
+extern char **environ;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int stages = argc > 1 ? atoi(argv[1]) : 20;
+    int runs = argc > 2 ? atoi(argv[2]) : 200;
+    if (stages < 1) stages = 1;
+    if (runs < 1) runs = 1;
+
+    size_t cap = 64 + (size_t)stages * 8;
+    char *line = malloc(cap);
+    if (!line) return EXIT_FAILURE;
+    size_t used = (size_t)snprintf(line, cap, "true < /dev/null");
+    for (int i = 1; i < stages; i++)
+        used += (size_t)snprintf(line + used, cap - used, " | cat");
+    snprintf(line + used, cap - used, " > /dev/null");
+
+    command_list_t *cmdlist = parse_input(line);
+    if (!cmdlist || cmdlist->pipeline_count == 0) {
+        fprintf(stderr, "parse error\n");
+        return EXIT_FAILURE;
+    }
+
+    double start = now_sec();
+    for (int i = 0; i < runs; i++) {
+        if (executor_execute(cmdlist->pipelines[0]->commands[0], 0) != 0) {
+            fprintf(stderr, "pipeline failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    double executor = (now_sec() - start) / runs;
+    command_list_free(cmdlist);
+
+    char *sh_argv[] = { "/bin/sh", "-c", line, NULL };
+    start = now_sec();
+    for (int i = 0; i < runs; i++) {
+        pid_t pid;
+        if (posix_spawn(&pid, "/bin/sh", NULL, NULL, sh_argv, environ) != 0) {
+            fprintf(stderr, "cannot spawn /bin/sh\n");
+            return EXIT_FAILURE;
+        }
+        waitpid(pid, NULL, 0);
+    }
+    double sh = (now_sec() - start) / runs;
+
+    printf("stages: %d, runs: %d\n", stages, runs);
+    printf("executor:  %8.1f us\n", executor * 1e6);
+    printf("/bin/sh:   %8.1f us\n", sh * 1e6);
+    free(line);
+    return 0;
+}
@@ -0,0 +1,54 @@
+// bench/bench_prompt.c
+//
+// Cost of drawing the prompt.
+// usage: bench_prompt [renders]
+// Times prompt_render with the compiled segments, then with the format
+// recompiled and the cwd re-read every time, which is what each prompt
+// used to cost (before counting the getpwuid/gethostname calls).
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "config.h"
+#include "prompt.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int renders = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (renders < 1) renders = 1;
+
+    shell_config_t config;
+    config_init(&config);
+    prompt_compile(&config);
+
+    char buf[512];
+    volatile char sink = 0;
+    double start = now_sec();
+    for (int i = 0; i < renders; i++) {
+        prompt_render(buf, sizeof(buf), &config);
+        sink ^= buf[0];
+    }
+    double cached = (now_sec() - start) / renders;
+
+    start = now_sec();
+    for (int i = 0; i < renders; i++) {
+        prompt_compile(&config);
+        prompt_invalidate_cwd();
+        prompt_render(buf, sizeof(buf), &config);
+        sink ^= buf[0];
+    }
+    double uncached = (now_sec() - start) / renders;
+
+    printf("renders: %d, prompt: %s\n", renders, buf);
+    printf("compiled:   %8.1f ns\n", cached * 1e9);
+    printf("recompiled: %8.1f ns\n", uncached * 1e9);
+    return 0;
+}
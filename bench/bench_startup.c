@@ -0,0 +1,50 @@
+// bench/bench_startup.c
+//
+// Startup cost of non-interactive execution.
+// usage: bench_startup [runs] [shell]
+// Times `kali_shell -c true` against `/bin/sh -c true` (or the given shell);
+// both are spawned and reaped the same way, so the difference is startup.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(const char *shell, long runs) {
+    char *argv[] = { (char *)shell, "-c", "true", NULL };
+    double start = now_sec();
+    for (long i = 0; i < runs; i++) {
+        pid_t pid;
+        int status;
+        if (posix_spawn(&pid, shell, NULL, NULL, argv, environ) != 0) {
+            fprintf(stderr, "cannot spawn %s\n", shell);
+            return -1;
+        }
+        waitpid(pid, &status, 0);
+    }
+    return (now_sec() - start) / runs;
+}
+
+int main(int argc, char **argv) {
+    long runs = argc > 1 ? atol(argv[1]) : 1000;
+    const char *other = argc > 2 ? argv[2] : "/bin/sh";
+    if (runs <= 0) runs = 1;
+
+    printf("runs: %ld\n", runs);
+    printf("%-16s %8.1f us\n", "./kali_shell", run("./kali_shell", runs) * 1e6);
+    printf("%-16s %8.1f us\n", other, run(other, runs) * 1e6);
+    return 0;
+}
@@ -0,0 +1,45 @@
+// src/alias.h
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stddef.h>
+#include "parser.h"
+
+// Alias table: open addressing with linear probing, grown as needed, so
+// lookups cost one hash of the word no matter how many aliases exist.
+
+// Define or replace name. from_config marks aliases read from
+// ~/.kali_shellrc, which a reload replaces. Returns 0, or -1 if out of
+// memory.
+int alias_set(const char *name, const char *value, int from_config);
+
+// Remove name; returns 0, or -1 if it was not defined
+int alias_unset(const char *name);
+
+// Value of the alias spelled by the len bytes at name, or NULL
+const char *alias_lookup(const char *name, size_t len);
+
+// Drop the aliases that came from the config file (before a reload)
+void alias_clear_config(void);
+
+// Drop every alias (unalias -a)
+void alias_clear(void);
+
+// Print name (or every alias, sorted) as `alias name='value'`. Returns 0,
+// or -1 if name is not defined.
+int alias_print(const char *name);
+
+// Expand aliases in every stage of a parsed line, in place. An alias may
+// stand for a pipeline and use other aliases; one that is already being
+// expanded is left alone. A pipeline made only of empty aliases ends up
+// with no stages. Returns 0, or -1 (reported) if an alias is not a single
+// pipeline.
+int alias_expand(command_list_t *cmdlist);
+
+// Bumped by every change to the table, so parsed lines can tell that their
+// expansion is out of date
+unsigned long alias_generation(void);
+
+void alias_free(void);
+
+#endif
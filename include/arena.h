@@ -0,0 +1,41 @@
+// src/arena.h
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator. Allocations are carved sequentially out of chunks and are
+// never freed individually; the whole arena is reset or released at once.
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;     // Previously filled chunk
+    size_t size;                  // Bytes available in data
+    size_t used;                  // Bytes handed out from data
+    _Alignas(max_align_t) char data[];
+} arena_chunk_t;
+
+typedef struct arena {
+    arena_chunk_t *head;          // Chunk currently allocated from
+    size_t chunk_size;            // Minimum size of new chunks
+} arena_t;
+
+// Prepare an empty arena whose first chunk will hold at least chunk_size bytes
+void arena_init(arena_t *arena, size_t chunk_size);
+
+// Allocate size bytes (max_align_t aligned); NULL if out of memory
+void *arena_alloc(arena_t *arena, size_t size);
+
+// Allocate zeroed memory
+void *arena_calloc(arena_t *arena, size_t count, size_t size);
+
+// Copy a string (or its first n bytes) into the arena
+char *arena_strdup(arena_t *arena, const char *s);
+char *arena_strndup(arena_t *arena, const char *s, size_t n);
+
+// Drop every allocation but keep the first chunk for reuse
+void arena_reset(arena_t *arena);
+
+// Free every chunk
+void arena_release(arena_t *arena);
+
+#endif
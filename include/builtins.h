@@ -10,7 +10,11 @@
 // Is command a builtin (checks first argv token)
 int is_builtin(const char *cmd);
 
-// Execute builtin command, return SHELL_OK or SHELL_EXIT
+// Execute builtin command. Returns its exit status (SHELL_OK, or 1 when it
+// failed), or SHELL_EXIT for `exit`
 int builtin_execute(command_t *cmd);
 
+// Status given to `exit n`, or -1 if exit was not given one
+int builtin_exit_code(void);
+
 #endif
@@ -0,0 +1,27 @@
+// src/cmdcache.h
+#ifndef CMDCACHE_H
+#define CMDCACHE_H
+
+#include "parser.h"
+
+// Parsed lines, kept by their text so a repeated line skips lexing, alias
+// expansion and $PATH lookups. The cache holds the most recently used
+// lines; entries are rebuilt when an alias or a cached command path changes.
+
+// Parsed, alias-expanded form of line, or NULL if it does not parse. The
+// list is shared: callers must not modify it and hand it back with
+// cmdcache_release when done.
+command_list_t *cmdcache_get(const char *line);
+
+// Drop a reference taken by cmdcache_get
+void cmdcache_release(command_list_t *cmdlist);
+
+// Forget every line (lists still in use stay valid until released)
+void cmdcache_clear(void);
+
+// Print hit/miss counters and the number of cached lines
+void cmdcache_print(void);
+
+void cmdcache_free(void);
+
+#endif
@@ -0,0 +1,29 @@
+// src/cmdhash.h
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+// Resolved-path cache for external commands (bash-style `hash`).
+// The table is dropped automatically when $PATH changes.
+
+// Searched when $PATH is unset, by lookups and by the completion index alike
+#define CMDHASH_DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+// Return the absolute path for command name, resolving through $PATH on a
+// miss. Returns NULL if name contains '/' or is not found. The pointer stays
+// valid until the entry is forgotten or the table is cleared.
+const char *cmdhash_lookup(const char *name);
+
+// Drop a single entry (e.g. after its cached path stopped existing)
+void cmdhash_forget(const char *name);
+
+// Drop every entry (`hash -r`)
+void cmdhash_clear(void);
+
+// Bumped whenever a resolved path is dropped (forget, clear, $PATH change),
+// so copies of looked-up paths can tell they may be out of date
+unsigned long cmdhash_generation(void);
+
+// Print the table as "hits<TAB>path", bash style
+void cmdhash_print(void);
+
+#endif
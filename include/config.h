@@ -1,6 +1,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
 #define PROMPT_MAX_LEN 256
 
 typedef enum {
@@ -12,9 +14,22 @@ typedef enum {
 typedef struct {
     char prompt_format[PROMPT_MAX_LEN];
     theme_t theme;
+    size_t history_size;          // Entries kept in history (histsize=)
+    size_t history_flush;         // Commands per history file append (histflush=)
 } shell_config_t;
 
 void config_init(shell_config_t *config);
+
+// Read ~/.kali_shellrc into config and the alias table in one pass. The
+// aliases it defined before are dropped first, so this also reloads.
 int config_load(shell_config_t *config);
 
+// Watch ~/.kali_shellrc for changes. Returns an fd that becomes readable
+// when its directory changes (inotify), or -1 if config_changed() has to
+// compare the file's mtime instead.
+int config_watch(void);
+
+// 1 if the file changed since config_load (drains the watch fd)
+int config_changed(void);
+
 #endif // CONFIG_H
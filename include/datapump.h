@@ -0,0 +1,46 @@
+// src/datapump.h
+#ifndef DATAPUMP_H
+#define DATAPUMP_H
+
+#include <stddef.h>
+
+// In-kernel byte moving for stages that only copy data (cat). Picks
+// copy_file_range between regular files, sendfile from a regular file,
+// splice when either end is a pipe, and read/write otherwise; each method
+// falls back to the next when the kernel refuses the fd pair.
+
+// The shell ignores SIGPIPE, so a vanished reader shows up as EPIPE.
+
+// Copy in_fd to out_fd until end of input. Returns 0, or -1 with errno set
+// (EINTR once SIGINT arrived inside datapump_begin/datapump_end).
+int datapump_copy(int in_fd, int out_fd);
+
+// Copy in_fd to every fd in outs. From a pipe the data is duplicated with
+// tee(2) and moved with splice(2), so no byte passes through userspace;
+// other inputs are read once and written to each sink.
+int datapump_fanout(int in_fd, const int *outs, size_t count);
+
+// Bracket a foreground pump run on the main thread, or the opening of a
+// pipeline's redirections: SIGINT is unblocked and interrupts the copy (or
+// the open) instead of reaching the shell
+void datapump_begin(void);
+void datapump_end(void);
+
+// Make pumps on the calling thread ignore SIGINT (background jobs)
+void datapump_detach(void);
+
+// Bracket the life of a pump thread (after datapump_detach, if any). A
+// foreground pump thread is then woken with EINTR out of a blocking call
+// when Ctrl-C arrives, e.g. opening or reading a fifo nobody writes to.
+void datapump_thread_begin(void);
+void datapump_thread_end(void);
+
+// Wake the foreground pump threads again if SIGINT arrived: one that was
+// between its interrupted check and a blocking call missed the first wake
+void datapump_kick(void);
+
+// 1 if SIGINT arrived since datapump_begin and the calling thread is not
+// detached, for pumps that wait on something other than a copy
+int datapump_interrupted(void);
+
+#endif
@@ -4,8 +4,17 @@
 
 #include "parser.h"
 
-// Execute an external command or pipeline command_t chain.
-// Returns 0 success, -1 failure
-int executor_execute(command_t *cmd);
+// Execute an external command or pipeline command_t chain as one job.
+// In the foreground, returns the exit status of the last stage (128+n if
+// killed or stopped by signal n, 127 if it could not be found); background
+// jobs return 0 at once. Returns -1 if the pipeline could not be set up.
+int executor_execute(command_t *cmd, int background);
+
+// Run a parsed line: pipelines joined by ; and & run in turn, && and ||
+// run their right side only after a success or a failure of the left.
+// Returns the status of the last pipeline that ran (builtins count as 0).
+// *exit_requested is set when `exit` ran, which ends the line there; so
+// does a foreground job killed by Ctrl-C.
+int executor_run_list(command_list_t *cmdlist, int *exit_requested);
 
 #endif
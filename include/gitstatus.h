@@ -0,0 +1,30 @@
+// src/gitstatus.h
+#ifndef GITSTATUS_H
+#define GITSTATUS_H
+
+#include <stddef.h>
+
+// Git branch and dirty state for the prompt, looked up on a worker thread so
+// a large repository never holds up the prompt. The branch comes straight
+// from .git/HEAD; dirtiness needs `git status`, which can take a while.
+
+// Start a lookup for dir, replacing any that has not started yet
+void gitstatus_request(const char *dir);
+
+// Wait up to budget_ms for the latest request, then copy its result into
+// buf: "branch" or "branch*" when there are uncommitted changes, "" outside
+// a repository. When the lookup is still running, the previous result for
+// the same directory is used, 0 is returned and gitstatus_event_fd() becomes
+// readable once the answer arrives. Returns 1 for a current result.
+int gitstatus_get(char *buf, size_t size, int budget_ms);
+
+// Readable when a late answer arrived; -1 before the first request
+int gitstatus_event_fd(void);
+
+// Drain gitstatus_event_fd()
+void gitstatus_event_clear(void);
+
+// Stop the worker at exit, without waiting for a lookup in progress
+void gitstatus_free(void);
+
+#endif
@@ -2,13 +2,28 @@
 #ifndef HISTORY_H
 #define HISTORY_H
 
-// Initialize history module and load from file
-void history_init(const char *filename);
+#include <stddef.h>
 
-// Add command line to history in-memory
+#define HISTORY_DEFAULT_SIZE 1000
+
+// Initialize history module with room for size entries and load from file.
+// New entries are appended to the file every flush_lines commands.
+void history_init(const char *filename, size_t size, size_t flush_lines);
+
+// Add command line to history and queue it for appending to the file
 void history_add(const char *line);
 
-// Save history to disk
+// Number of entries currently held
+size_t history_len(void);
+
+// Entry at index (0 is the oldest), or NULL if out of range
+const char *history_at(size_t index);
+
+// Stable number of the entry at index 0. Entries keep their number
+// (history_first() + index) while they stay in history.
+size_t history_first(void);
+
+// Write any queued entries to disk
 void history_save(void);
 
 // Free all resources used by history
@@ -0,0 +1,29 @@
+// src/histsearch.h
+#ifndef HISTSEARCH_H
+#define HISTSEARCH_H
+
+#include <stddef.h>
+
+// Search over the shared history store through a trigram index, plus the
+// readline key bindings (Ctrl-R, Up/Down) that browse it.
+
+typedef struct hist_match {
+    size_t number;                // Stable history number (history_first() based)
+    const char *line;
+} hist_match_t;
+
+// Find up to max distinct lines containing pattern (case-insensitive).
+// Lines starting with pattern rank first, then lines where it starts a
+// word, then the rest; newest first within each group. Returns the count.
+size_t histsearch_find(const char *pattern, hist_match_t *out, size_t max);
+
+// Bind Ctrl-R incremental search and Up/Down/Ctrl-P/Ctrl-N navigation
+void histsearch_bind_keys(void);
+
+// Reset Up/Down navigation to the newest entry; call before each readline()
+void histsearch_reset_nav(void);
+
+// Free the search index
+void histsearch_free(void);
+
+#endif
@@ -0,0 +1,121 @@
+// src/jobs.h
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <stddef.h>
+#include <termios.h>
+#include <pthread.h>
+
+// Job table. Every pipeline is a job; with job control (interactive shell on
+// a terminal) each job runs in its own process group and the foreground job
+// owns the terminal. Children are only ever waited by pid, never with
+// waitpid(-1), so nothing is reaped twice.
+
+typedef enum {
+    PROC_RUNNING,
+    PROC_STOPPED,
+    PROC_DONE
+} proc_state_t;
+
+typedef struct process {
+    pid_t pid;                    // 0 if the stage never started
+    int status;                   // Exit status once done (128+n for signal n)
+    int signal;                   // Signal that stopped or killed it, 0 if none
+    proc_state_t state;
+    int pidfd;                    // Readable once it exits; -1 if not watched
+    struct timespec started;      // CLOCK_MONOTONIC when it was started
+    double real;                  // Seconds from start until it was reaped
+    struct rusage usage;          // From wait4, once done
+} process_t;
+
+typedef struct job {
+    int id;                       // Job number shown as [n]
+    pid_t pgid;                   // Process group, 0 until the first stage starts
+    char *command;                // Command text for listings
+    process_t *procs;             // One per pipeline stage
+    size_t nprocs;
+    int changed;                  // State changed since last reported
+    unsigned long seq;            // Bumped when started, stopped or resumed;
+                                  // the highest is the current job (%+)
+    struct termios tmodes;        // Terminal modes saved when it stopped
+    int has_tmodes;
+    pthread_t *threads;           // In-shell pumps working for the job
+    size_t nthreads;
+    int threads_active;           // Pumps not finished yet (atomic)
+    struct job *next;
+} job_t;
+
+// Set up job control when interactive and stdin is a terminal: the shell
+// takes its own process group and the terminal, and ignores the job control
+// signals. When interactive, SIGCHLD is blocked and children are watched
+// through jobs_event_fd(). Call before starting any thread.
+void jobs_init(int interactive);
+
+// 1 if jobs get their own process group and the terminal
+int jobs_control_enabled(void);
+
+// epoll fd, readable when a child exited or stopped or a pump finished;
+// drain it with jobs_reap(). -1 when not interactive.
+int jobs_event_fd(void);
+
+// Add a job of nprocs stages to the table; procs start as not-started/done
+job_t *job_create(const char *command, size_t nprocs);
+
+// Record that stage i started as pid (joining the job's group)
+void job_set_pid(job_t *job, size_t i, pid_t pid);
+
+// Hand a pump thread to job; the job runs until every pump has called
+// job_thread_done(), and the threads are joined before it is dropped
+void job_add_thread(job_t *job, pthread_t thread);
+void job_thread_done(job_t *job);
+
+// Remove job from the table and free it, joining its threads
+void job_discard(job_t *job);
+
+// Give job the terminal and wait until it finishes or stops. A finished job
+// is removed from the table. Returns its exit status (128+n if stopped by n;
+// with pipefail, the rightmost failing stage's).
+// cont: send SIGCONT first (fg of a stopped job)
+int job_wait_foreground(job_t *job, int cont);
+
+// Per-stage exit statuses of the last foreground job (PIPESTATUS)
+size_t jobs_pipestatus(const int **statuses);
+
+// Stages of the last foreground job as they ended, with their resource
+// usage (pid 0 for a stage the shell ran itself)
+size_t jobs_last_procs(const process_t **procs);
+
+// Leave job running in the background, continuing it if stopped
+void job_run_background(job_t *job, int cont);
+
+// Give the terminal back to the shell while a foreground job's pumps still
+// run but its process group is gone (every process of it exited)
+void jobs_reclaim_terminal(void);
+
+// Non-blocking reap of the children that changed state
+void jobs_reap(void);
+
+// Number of jobs in the table (running in the background or stopped)
+size_t jobs_count(void);
+
+// 1 if jobs_notify() has something to report
+int jobs_pending(void);
+
+// Report background jobs that finished or stopped, dropping finished ones.
+// Returns the number of lines printed.
+int jobs_notify(void);
+
+// Find a job by spec: %n, n, %%, %+ or NULL for the current job
+job_t *job_find(const char *spec);
+
+// Print the job table (jobs builtin)
+void jobs_print(void);
+
+// Hang up stopped jobs and free the table (at shell exit). Waits for the
+// pumps of background jobs to finish their copies.
+void jobs_free(void);
+
+#endif
@@ -0,0 +1,52 @@
+// src/metrics.h
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <time.h>
+#include "parser.h"
+
+// Per-command latency metrics, off unless `metrics on`. For each command
+// name the shell keeps log-linear histograms of parse time, spawn latency
+// (posix_spawn until the child has exec'd) and wall time of foreground
+// pipelines, plus run and failure counts. Callers check metrics_enabled()
+// before taking timestamps, so a disabled session pays one call per line.
+
+typedef enum {
+    METRIC_PARSE,                 // Line text to runnable command list
+    METRIC_SPAWN,                 // One stage's spawn
+    METRIC_WALL,                  // Foreground pipeline, start to finish
+    METRIC_COUNT
+} metric_t;
+
+int metrics_enabled(void);
+
+// Start recording; if dump_path is not NULL the Prometheus text is
+// written there by metrics_free
+void metrics_start(const char *dump_path);
+void metrics_stop(void);
+
+// Seconds since *since on CLOCK_MONOTONIC
+double metrics_elapsed(const struct timespec *since);
+
+// Record one sample for command (argv[0]; the directory part is ignored)
+void metrics_record(metric_t metric, const char *command, double seconds);
+
+// Record the time since *since to parse cmdlist, under its first command
+void metrics_record_parse(const command_list_t *cmdlist, const struct timespec *since);
+
+// Count a finished foreground pipeline
+void metrics_record_status(const char *command, int status);
+
+// p50/p95/p99 per command on stdout
+void metrics_print(void);
+
+// Forget every sample
+void metrics_reset(void);
+
+// Write Prometheus text exposition format to path. Returns 0 or -1 (reported)
+int metrics_dump(const char *path);
+
+// Dump if a path was given to metrics_start, then free everything
+void metrics_free(void);
+
+#endif
@@ -0,0 +1,20 @@
+// src/options.h
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+// Shell options toggled with `set -o name` / `set +o name`
+typedef enum {
+    OPT_PIPEFAIL,                 // Pipeline status is the rightmost failing stage
+    OPT_ZEROCOPY,                 // Run plain cat stages in-process (on by default)
+    OPT_COUNT
+} shell_option_t;
+
+int option_enabled(shell_option_t opt);
+
+// Set an option by name; returns 0, or -1 if there is no such option
+int option_set(const char *name, int enabled);
+
+// Print every option and its state (set -o)
+void options_print(void);
+
+#endif
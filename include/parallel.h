@@ -0,0 +1,35 @@
+// src/parallel.h
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <sys/types.h>
+
+// parallel [-j N] [-k|-u] command [arg...] [::: item...]
+//
+// Runs command once per item with at most N jobs at a time (default: the
+// number of online CPUs). Items are the words after ::: or, without them,
+// the lines of standard input, read as the workers need them. Every {} in
+// a word is replaced by the item; with no {} the item is appended. Each
+// job's stdout and stderr are collected and written in one piece, in input
+// order (-k, the default) or as jobs finish (-u). The exit status is the
+// number of failed jobs, at most 101.
+
+typedef struct parallel parallel_t;
+
+// Parse a parallel stage's arguments (argv[0] is "parallel") and resolve
+// the command. Returns NULL after reporting to err_fd, with *status set to
+// 2 for a usage error or 127 for an unknown command.
+parallel_t *parallel_prepare(int argc, char **argv, int err_fd, int *status);
+
+// Run every job and write its output to out_fd/err_fd, then free p.
+// Workers join process group pgid (the shell job's, 0 if it has no
+// process), so Ctrl-C and Ctrl-Z reach them with the rest of the job;
+// a worker killed by SIGINT stops the run. Without a group, workers of a
+// detached (background) run get process groups of their own, so signals
+// from the terminal pass them by. Returns the exit status, or 128+n when
+// stopped by SIGINT or a closed output (SIGPIPE).
+int parallel_run(parallel_t *p, int in_fd, int out_fd, int err_fd, int detached, pid_t pgid);
+
+void parallel_free(parallel_t *p);
+
+#endif
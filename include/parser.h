@@ -2,6 +2,16 @@
 #define PARSER_H
 
 #include <stddef.h>
+#include "arena.h"
+
+// All strings and structs of a parsed line live in the owning
+// command_list_t's arena.
+
+// An output redirection beyond the first one
+typedef struct output_redir {
+    char *file;
+    int append;                   // 1 for >>
+} output_redir_t;
 
 typedef struct command {
     char **argv;                   // Argument vector; null-terminated
@@ -10,20 +20,55 @@ typedef struct command {
     char *input_file;             // Input redirection file name
     char *output_file;            // Output redirection file name
     int append_output;            // 1 if output is append (>>), 0 if overwrite (>)
+    output_redir_t *more_outputs; // Further > / >> targets; stdout goes to all of them
+    int more_output_count;
+    char *error_file;             // Error redirection file name (2>, 2>>)
+    int append_error;             // 1 if error output is append (2>>)
+    int stderr_to_stdout;         // 1 for 2>&1 and &>: stderr follows stdout
+    int stderr_before_out;        // 2>&1 came before the > redirections: stderr
+                                  // gets the stdout they replace, as in sh
+    int pipe_stderr;              // 1 for |&: stderr also feeds pipe_to
     struct command *pipe_to;      // Next command in pipeline or NULL
     int pipe_count;               // Number of pipes following
+    const char *path;             // Resolved by the command cache, or NULL
 } command_t;
 
+// Stages joined by | or |&, run as one job
+typedef struct pipeline {
+    command_t **commands;         // Stages, also linked through pipe_to
+    size_t count;                 // Number of stages (0 only after an empty alias)
+    int background;               // 1 if followed by &
+} pipeline_t;
+
+typedef enum {
+    NODE_PIPELINE,                // Leaf: run pipeline
+    NODE_AND,                     // left && right
+    NODE_OR,                      // left || right
+    NODE_SEQ                      // left ; right (left may run in the background)
+} node_kind_t;
+
+typedef struct node {
+    node_kind_t kind;
+    pipeline_t *pipeline;         // NODE_PIPELINE only
+    struct node *left;
+    struct node *right;
+} node_t;
+
+// A parsed line: a tree of pipelines joined by ;, &, && and ||
 typedef struct command_list {
-    command_t **commands;         // Array of parsed commands
-    size_t count;                 // Number of commands in array
+    node_t *root;                 // NULL for an empty line
+    pipeline_t **pipelines;       // Every pipeline of the tree, in input order
+    size_t pipeline_count;
+    int refs;                     // References held through the command cache
+    arena_t arena;                // Owns every allocation of the list
 } command_list_t;
 
 // Parse input command line into a command_list_t structure
 command_list_t *parse_input(const char *input);
 
-// Free memory allocated to a command_t
-void command_free(command_t *cmd);
+// Why the last parse_input() returned NULL, or NULL for a plain syntax
+// error (or when it did not fail)
+const char *parse_error(void);
 
 // Free memory allocated to a command_list_t and all contained commands
 void command_list_free(command_list_t *cmdlist);
@@ -0,0 +1,25 @@
+// src/pathindex.h
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include <stddef.h>
+
+// Sorted index of executable names found in $PATH, used by tab completion.
+// The first build runs on a background thread; later refreshes only rescan
+// directories that inotify (or a changed mtime) reports as modified.
+
+// Start building the index in the background
+void pathindex_init(void);
+
+// Bring the index up to date: waits for the initial build, rebuilds if $PATH
+// changed and rescans directories that changed since the last refresh
+void pathindex_refresh(void);
+
+// Point *names at the sorted run of names starting with prefix and return its
+// length. The run stays valid until the next pathindex_refresh.
+size_t pathindex_prefix(const char *prefix, const char *const **names);
+
+// Free the index and stop watching directories
+void pathindex_free(void);
+
+#endif
@@ -4,6 +4,34 @@
 #include <stddef.h>
 #include "config.h"
 
+// Prompt escapes: \u user, \h host, \w cwd, \$ # for root, \? last exit
+// status, \j job count, \t last command's duration, \g (git branch), with *
+// when the work tree has uncommitted changes.
+
+// Compile config->prompt_format into segments; call again whenever the
+// config changes. User, host and euid are looked up only the first time.
+void prompt_compile(const shell_config_t *config);
+
+// The working directory changed (cd); it is re-read on the next prompt
+void prompt_invalidate_cwd(void);
+
+// Record the last command's exit status and wall time for \? and \t
+void prompt_command_done(int status, double seconds);
+
+// Draw a new prompt into buf (compiling it first if needed). The git
+// segment gets a short time budget; if the lookup takes longer, the prompt
+// is drawn without it and prompt_event_fd() signals when to redraw.
 void prompt_render(char *buf, size_t bufsize, const shell_config_t *config);
 
+// Redraw the current prompt with segments that arrived late
+void prompt_refresh(char *buf, size_t bufsize, const shell_config_t *config);
+
+// Readable when a late segment arrived (-1 if none can); drain it with
+// prompt_event_clear() before calling prompt_refresh()
+int prompt_event_fd(void);
+void prompt_event_clear(void);
+
+// Stop background lookups (at exit)
+void prompt_free(void);
+
 #endif // PROMPT_H
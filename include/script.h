@@ -0,0 +1,15 @@
+// src/script.h
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+// Non-interactive execution (kali_shell -c '...' and kali_shell script.ksh).
+// No readline, prompt, completion, history or aliases are involved.
+// Both return the exit status of the last command run.
+
+// Run each line of text
+int script_run_string(const char *text);
+
+// Stream and run the lines of the file at path
+int script_run_file(const char *path);
+
+#endif
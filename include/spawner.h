@@ -0,0 +1,36 @@
+// src/spawner.h
+#ifndef SPAWNER_H
+#define SPAWNER_H
+
+#include <sys/types.h>
+
+// Process launch engine. POSIX_SPAWN uses posix_spawn() (glibc implements it
+// with clone(CLONE_VM|CLONE_VFORK), so no page tables are copied); FORK is the
+// classic fork()+exec fallback.
+typedef enum {
+    SPAWN_ENGINE_POSIX,
+    SPAWN_ENGINE_FORK
+} spawn_engine_t;
+
+typedef struct spawn_req {
+    const char *path;             // Absolute path to exec, or NULL to search PATH for argv[0]
+    char *const *argv;            // Argument vector; null-terminated
+    int stdin_fd;                 // fd to install as stdin, or -1 to inherit
+    int stdout_fd;                // fd to install as stdout, or -1 to inherit
+    int stderr_fd;                // fd to install as stderr, or -1 to inherit
+    int stderr_to_stdout;         // 1 to point stderr at the (new) stdout instead
+    int setpgroup;                // 1 to move the child into process group pgid
+    pid_t pgid;                   // Group to join; 0 starts a new group led by the child
+    int take_terminal;            // 1 to hand the terminal on stdin to the child's group
+} spawn_req_t;
+
+// Select the engine used by spawn_process (default SPAWN_ENGINE_POSIX)
+void spawn_set_engine(spawn_engine_t engine);
+spawn_engine_t spawn_get_engine(void);
+
+// Launch a child described by req. The fds in req must be O_CLOEXEC; they are
+// duplicated onto 0/1/2 in the child only. Returns 0 and stores the child pid,
+// or an errno value if the program could not be started.
+int spawn_process(const spawn_req_t *req, pid_t *pid);
+
+#endif
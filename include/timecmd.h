@@ -0,0 +1,32 @@
+// src/timecmd.h
+#ifndef TIMECMD_H
+#define TIMECMD_H
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "parser.h"
+
+// `time [-j] pipeline`: run the pipeline, then report its wall time and each
+// stage's resource usage (from wait4) on stderr, as a table or with -j as
+// JSON lines. The executor strips the prefix with timecmd_begin, runs the
+// rest and calls timecmd_end.
+
+typedef struct timecmd {
+    int json;                     // -j: one JSON object per line
+    struct timespec started;
+    struct rusage self;           // The shell's own usage, for in-shell stages
+} timecmd_t;
+
+// 1 if cmd is a `time` prefix
+int timecmd_is_time(const command_t *cmd);
+
+// Fill *stripped with head minus `time` and its options and start the
+// clock. Returns 0, or -1 (reported) on a bad option.
+int timecmd_begin(timecmd_t *t, const command_t *head, command_t *stripped);
+
+// Print the report. ran_job: the pipeline ran as a job, so the job table
+// holds its stages; otherwise only the wall time is known.
+void timecmd_end(timecmd_t *t, const command_t *stripped, int ran_job, int status);
+
+#endif
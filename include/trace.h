@@ -0,0 +1,62 @@
+// src/trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+// Execution trace: a fixed ring of the last TRACE_RING_SIZE events (lines
+// read, alias expansions, parses, opens, pipes, dup2s, spawns, waits and
+// signals) with CLOCK_MONOTONIC timestamps. Recording copies into a
+// preallocated slot and never allocates. Any thread (pumps included) may
+// record; a dump skips a slot still being written. `trace dump <file>`
+// writes the ring as JSON lines; with KALI_SHELL_TRACE=<file> (or - for
+// stderr) every event is also written there as it happens.
+//
+// TRACE() tests one flag, so a shell that is not tracing pays a single
+// branch per hook.
+
+#define TRACE_RING_SIZE 4096
+
+typedef enum {
+    TRACE_LINE,                   // a: length; text: the line
+    TRACE_ALIAS,                  // a: stages it expanded to; text: alias name
+    TRACE_PARSE,                  // a: pipelines, b: ns; text: first command
+    TRACE_CACHE_HIT,              // Same as TRACE_PARSE, served by the command cache
+    TRACE_OPEN,                   // a: fd (-1 on failure), b: errno; text: path
+    TRACE_PIPE,                   // a: read end, b: write end
+    TRACE_DUP2,                   // a: from, b: to; done by the spawned child
+    TRACE_SPAWN,                  // a: pid, b: errno (0 on success); text: command
+    TRACE_WAIT,                   // a: pid, b: status; text: what happened
+    TRACE_SIGNAL,                 // a: signal, b: signals coalesced; text: name
+    TRACE_KIND_COUNT
+} trace_kind_t;
+
+extern int trace_active;
+
+#define TRACE(kind, a, b, text)                                               \
+    do {                                                                      \
+        if (trace_active) trace_record((kind), (a), (b), (text));             \
+    } while (0)
+
+// Start streaming if KALI_SHELL_TRACE is set
+void trace_init(void);
+
+void trace_record(trace_kind_t kind, long long a, long long b, const char *text);
+
+// CLOCK_MONOTONIC in nanoseconds, for durations carried in an event
+long long trace_now(void);
+
+void trace_start(void);
+void trace_stop(void);
+
+// Forget the recorded events
+void trace_clear(void);
+
+// Write the ring, oldest first, as JSON lines ("-" for stdout). Returns 0
+// or -1 (reported)
+int trace_dump(const char *path);
+
+// State and event counts
+void trace_print(void);
+
+void trace_free(void);
+
+#endif
@@ -0,0 +1,373 @@
+// src/alias.c
+#define _GNU_SOURCE
+#include "alias.h"
+#include "parser.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIAS_INITIAL_CAP 32
+
+typedef struct alias_entry {
+    char *name;                   // Key, NULL if slot empty
+    char *value;
+    size_t name_len;
+    int from_config;              // Defined by ~/.kali_shellrc
+    command_list_t *tmpl;         // value parsed on first use, NULL until then
+    int expanding;                // On the current expansion chain
+    int deleted;                  // Tombstone left by alias_unset
+} alias_entry_t;
+
+static alias_entry_t *table = NULL;
+static size_t table_cap = 0;
+static size_t table_used = 0;     // Live entries plus tombstones
+static size_t table_live = 0;
+static unsigned long generation = 0;
+
+// FNV-1a over len bytes, so a word can be looked up in place
+static size_t hash_name(const char *s, size_t len) {
+    size_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static alias_entry_t *find(const char *name, size_t len) {
+    if (table_cap == 0) return NULL;
+    size_t mask = table_cap - 1;
+    for (size_t i = hash_name(name, len) & mask;; i = (i + 1) & mask) {
+        alias_entry_t *e = &table[i];
+        if (!e->name && !e->deleted) return NULL;
+        if (e->name && e->name_len == len && memcmp(e->name, name, len) == 0) return e;
+    }
+}
+
+static int grow(void) {
+    size_t new_cap = table_cap ? table_cap * 2 : ALIAS_INITIAL_CAP;
+    // Mostly tombstones: rehash at the same size
+    if (table_live * 2 < table_cap) new_cap = table_cap;
+    alias_entry_t *new_table = calloc(new_cap, sizeof(alias_entry_t));
+    if (!new_table) return -1;
+
+    for (size_t i = 0; i < table_cap; i++) {
+        if (!table[i].name) continue;
+        size_t j = hash_name(table[i].name, table[i].name_len) & (new_cap - 1);
+        while (new_table[j].name) j = (j + 1) & (new_cap - 1);
+        new_table[j] = table[i];
+    }
+    free(table);
+    table = new_table;
+    table_cap = new_cap;
+    table_used = table_live;
+    return 0;
+}
+
+static void remove_entry(alias_entry_t *e) {
+    free(e->name);
+    free(e->value);
+    command_list_free(e->tmpl);
+    e->name = e->value = NULL;
+    e->tmpl = NULL;
+    e->deleted = 1;
+    table_live--;
+    generation++;
+}
+
+int alias_set(const char *name, const char *value, int from_config) {
+    if (!name || !*name || !value) return -1;
+    size_t len = strlen(name);
+
+    char *copy = strdup(value);
+    if (!copy) return -1;
+
+    alias_entry_t *e = find(name, len);
+    if (e) {
+        free(e->value);
+        command_list_free(e->tmpl);
+        e->tmpl = NULL;
+        e->value = copy;
+        e->from_config = from_config;
+        generation++;
+        return 0;
+    }
+
+    if ((table_used + 1) * 4 > table_cap * 3 && grow() != 0) {
+        free(copy);
+        return -1;
+    }
+    size_t mask = table_cap - 1;
+    size_t i = hash_name(name, len) & mask;
+    while (table[i].name) i = (i + 1) & mask;
+
+    e = &table[i];
+    if (!(e->name = strdup(name))) {
+        free(copy);
+        return -1;
+    }
+    if (!e->deleted) table_used++;
+    e->value = copy;
+    e->name_len = len;
+    e->from_config = from_config;
+    e->tmpl = NULL;
+    e->expanding = 0;
+    e->deleted = 0;
+    table_live++;
+    generation++;
+    return 0;
+}
+
+int alias_unset(const char *name) {
+    if (!name) return -1;
+    alias_entry_t *e = find(name, strlen(name));
+    if (!e) return -1;
+    remove_entry(e);
+    return 0;
+}
+
+const char *alias_lookup(const char *name, size_t len) {
+    alias_entry_t *e = find(name, len);
+    return e ? e->value : NULL;
+}
+
+void alias_clear_config(void) {
+    for (size_t i = 0; i < table_cap; i++) {
+        if (table[i].name && table[i].from_config) remove_entry(&table[i]);
+    }
+}
+
+void alias_clear(void) {
+    for (size_t i = 0; i < table_cap; i++) {
+        if (table[i].name) remove_entry(&table[i]);
+    }
+}
+
+static void print_entry(const alias_entry_t *e) {
+    // Single quotes inside the value are written as '\''
+    fputs("alias ", stdout);
+    fputs(e->name, stdout);
+    fputs("='", stdout);
+    for (const char *p = e->value; *p; p++) {
+        if (*p == '\'')
+            fputs("'\\''", stdout);
+        else
+            putchar(*p);
+    }
+    fputs("'\n", stdout);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const alias_entry_t *x = *(const alias_entry_t *const *)a;
+    const alias_entry_t *y = *(const alias_entry_t *const *)b;
+    return strcmp(x->name, y->name);
+}
+
+int alias_print(const char *name) {
+    if (name) {
+        alias_entry_t *e = find(name, strlen(name));
+        if (!e) return -1;
+        print_entry(e);
+        return 0;
+    }
+
+    if (table_live == 0) return 0;
+    const alias_entry_t **sorted = malloc(table_live * sizeof(*sorted));
+    if (!sorted) return 0;
+    size_t n = 0;
+    for (size_t i = 0; i < table_cap; i++) {
+        if (table[i].name) sorted[n++] = &table[i];
+    }
+    qsort(sorted, n, sizeof(*sorted), compare_entries);
+    for (size_t i = 0; i < n; i++) print_entry(sorted[i]);
+    free(sorted);
+    return 0;
+}
+
+unsigned long alias_generation(void) {
+    return generation;
+}
+
+void alias_free(void) {
+    for (size_t i = 0; i < table_cap; i++) {
+        free(table[i].name);
+        free(table[i].value);
+        command_list_free(table[i].tmpl);
+    }
+    free(table);
+    table = NULL;
+    table_cap = table_used = table_live = 0;
+}
+
+// Expansion works on parsed stages. Each alias value is parsed once into
+// a template (a pipeline) and kept until the alias changes; expanding a
+// stage copies the template's stages into the line's arena, so running an
+// alias never lexes its text again. An alias is not expanded again inside
+// its own expansion, which ends loops like ls='ls -F' or a=b, b=a.
+
+typedef struct stage_vec {
+    command_t **items;
+    size_t count;
+    size_t cap;
+    arena_t *arena;
+} stage_vec_t;
+
+static int push_stage(stage_vec_t *vec, command_t *cmd) {
+    if (vec->count == vec->cap) {
+        size_t cap = vec->cap ? vec->cap * 2 : 8;
+        command_t **items = arena_alloc(vec->arena, cap * sizeof(command_t *));
+        if (!items) return -1;
+        if (vec->count) memcpy(items, vec->items, vec->count * sizeof(command_t *));
+        vec->items = items;
+        vec->cap = cap;
+    }
+    vec->items[vec->count++] = cmd;
+    return 0;
+}
+
+static char *copy_str(arena_t *arena, const char *s, int *failed) {
+    if (!s) return NULL;
+    char *copy = arena_strdup(arena, s);
+    if (!copy) *failed = 1;
+    return copy;
+}
+
+// Copy a template stage into arena. The stage being expanded (use) adds its
+// arguments after the template's and its redirections replace the
+// template's, as if the alias text had been typed in its place.
+static command_t *instantiate(arena_t *arena, const command_t *tmpl, const command_t *use) {
+    int failed = 0;
+    command_t *cmd = arena_alloc(arena, sizeof(command_t));
+    if (!cmd) return NULL;
+    *cmd = *tmpl;
+
+    int extra = use ? use->argc - 1 : 0;
+    cmd->argc = tmpl->argc + extra;
+    cmd->argv = arena_alloc(arena, ((size_t)cmd->argc + 1) * sizeof(char *));
+    if (!cmd->argv) return NULL;
+    for (int i = 0; i < tmpl->argc; i++) cmd->argv[i] = copy_str(arena, tmpl->argv[i], &failed);
+    for (int i = 0; i < extra; i++) cmd->argv[tmpl->argc + i] = use->argv[i + 1];
+    cmd->argv[cmd->argc] = NULL;
+
+    cmd->raw = copy_str(arena, tmpl->raw, &failed);
+    cmd->input_file = copy_str(arena, tmpl->input_file, &failed);
+    cmd->output_file = copy_str(arena, tmpl->output_file, &failed);
+    cmd->error_file = copy_str(arena, tmpl->error_file, &failed);
+    if (tmpl->more_output_count > 0) {
+        cmd->more_outputs = arena_alloc(arena, (size_t)tmpl->more_output_count * sizeof(output_redir_t));
+        if (!cmd->more_outputs) return NULL;
+        for (int i = 0; i < tmpl->more_output_count; i++) {
+            cmd->more_outputs[i].file = copy_str(arena, tmpl->more_outputs[i].file, &failed);
+            cmd->more_outputs[i].append = tmpl->more_outputs[i].append;
+        }
+    }
+    if (failed) return NULL;
+    if (!use) return cmd;
+
+    // Raw text for job listings: the template followed by the arguments
+    const char *rest = use->raw ? use->raw : "";
+    while (*rest == ' ' || *rest == '\t') rest++;
+    while (*rest && *rest != ' ' && *rest != '\t') rest++;
+    if (*rest) {
+        size_t len = strlen(cmd->raw ? cmd->raw : "") + strlen(rest) + 1;
+        char *raw = arena_alloc(arena, len);
+        if (!raw) return NULL;
+        snprintf(raw, len, "%s%s", cmd->raw ? cmd->raw : "", rest);
+        cmd->raw = raw;
+    }
+
+    if (use->input_file) cmd->input_file = use->input_file;
+    if (use->output_file) {
+        cmd->output_file = use->output_file;
+        cmd->append_output = use->append_output;
+        cmd->more_outputs = use->more_outputs;
+        cmd->more_output_count = use->more_output_count;
+    }
+    if (use->error_file || use->stderr_to_stdout) {
+        cmd->error_file = use->error_file;
+        cmd->append_error = use->append_error;
+        cmd->stderr_to_stdout = use->stderr_to_stdout;
+        cmd->stderr_before_out = use->stderr_before_out;
+    }
+    cmd->pipe_stderr = use->pipe_stderr;
+    return cmd;
+}
+
+// The stages e stands for; NULL unless its value is a single foreground
+// pipeline (or empty), the only thing that can take a stage's place
+static const pipeline_t *template_of(alias_entry_t *e) {
+    static const pipeline_t empty = { 0 };
+    if (!e->tmpl) e->tmpl = parse_input(e->value);
+    if (!e->tmpl) return NULL;
+    if (!e->tmpl->root) return &empty;
+    if (e->tmpl->root->kind != NODE_PIPELINE || e->tmpl->root->pipeline->background)
+        return NULL;
+    return e->tmpl->root->pipeline;
+}
+
+// Append stage cmd (already in the line's arena) to vec, expanded
+static int expand_stage(stage_vec_t *vec, command_t *cmd) {
+    alias_entry_t *e = cmd->argv[0] ? find(cmd->argv[0], strlen(cmd->argv[0])) : NULL;
+    if (!e || e->expanding) return push_stage(vec, cmd);
+
+    const pipeline_t *tmpl = template_of(e);
+    if (!tmpl) {
+        fprintf(stderr, "alias: %s: '%s' is not a pipeline\n", e->name, e->value);
+        return -1;
+    }
+
+    TRACE(TRACE_ALIAS, (long long)tmpl->count, 0, e->name);
+    e->expanding = 1;
+    int ret = 0;
+    if (tmpl->count == 0) {
+        // An empty alias leaves the rest of the stage
+        command_t *rest = arena_alloc(vec->arena, sizeof(command_t));
+        if (rest) {
+            *rest = *cmd;
+            rest->argv++;
+            rest->argc--;
+        }
+        if (!rest)
+            ret = -1;
+        else if (rest->argc > 0 || rest->input_file || rest->output_file || rest->error_file)
+            ret = expand_stage(vec, rest);
+    }
+    for (size_t i = 0; i < tmpl->count && ret == 0; i++) {
+        int last = (i + 1 == tmpl->count);
+        command_t *stage = instantiate(vec->arena, tmpl->commands[i], last ? cmd : NULL);
+        ret = stage ? expand_stage(vec, stage) : -1;
+    }
+    e->expanding = 0;
+    return ret;
+}
+
+static int expand_pipeline(arena_t *arena, pipeline_t *p) {
+    // Nothing to do unless some stage starts with an alias
+    size_t i = 0;
+    while (i < p->count && !(p->commands[i]->argv[0] &&
+                             find(p->commands[i]->argv[0], strlen(p->commands[i]->argv[0]))))
+        i++;
+    if (i == p->count) return 0;
+
+    stage_vec_t vec = { .arena = arena };
+    for (i = 0; i < p->count; i++) {
+        if (expand_stage(&vec, p->commands[i]) == -1) return -1;
+    }
+
+    for (size_t k = 0; k < vec.count; k++) {
+        vec.items[k]->pipe_to = k + 1 < vec.count ? vec.items[k + 1] : NULL;
+        vec.items[k]->pipe_count = k + 1 < vec.count;
+    }
+    p->commands = vec.items;
+    p->count = vec.count;
+    return 0;
+}
+
+int alias_expand(command_list_t *cmdlist) {
+    if (!cmdlist || table_live == 0) return 0;
+    for (size_t i = 0; i < cmdlist->pipeline_count; i++) {
+        if (expand_pipeline(&cmdlist->arena, cmdlist->pipelines[i]) == -1) return -1;
+    }
+    return 0;
+}
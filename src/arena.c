@@ -0,0 +1,94 @@
+// src/arena.c
+#define _GNU_SOURCE
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <stdint.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+#define ARENA_DEFAULT_CHUNK 1024
+
+void arena_init(arena_t *arena, size_t chunk_size) {
+    arena->head = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+}
+
+static arena_chunk_t *new_chunk(arena_t *arena, size_t need) {
+    size_t size = arena->chunk_size;
+    // Later chunks grow so long lines need only a few
+    if (arena->head && arena->head->size * 2 > size) size = arena->head->size * 2;
+    if (size < need) size = need;
+
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + size);
+    if (!chunk) return NULL;
+    chunk->next = arena->head;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->head = chunk;
+    return chunk;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    arena_chunk_t *chunk = arena->head;
+    size_t offset = 0;
+    if (chunk) offset = (chunk->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (!chunk || offset + size > chunk->size) {
+        chunk = new_chunk(arena, size);
+        if (!chunk) return NULL;
+        offset = 0;
+    }
+    chunk->used = offset + size;
+    return chunk->data + offset;
+}
+
+void *arena_calloc(arena_t *arena, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void *p = arena_alloc(arena, count * size);
+    if (p) memset(p, 0, count * size);
+    return p;
+}
+
+char *arena_strndup(arena_t *arena, const char *s, size_t n) {
+    // Strings need no alignment; pack them right after the last allocation
+    arena_chunk_t *chunk = arena->head;
+    char *p;
+    if (chunk && chunk->used + n + 1 <= chunk->size) {
+        p = chunk->data + chunk->used;
+        chunk->used += n + 1;
+    } else {
+        p = arena_alloc(arena, n + 1);
+        if (!p) return NULL;
+    }
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+char *arena_strdup(arena_t *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+void arena_reset(arena_t *arena) {
+    arena_chunk_t *chunk = arena->head;
+    if (!chunk) return;
+    // Keep the oldest chunk: it is the one sized for the common case
+    while (chunk->next) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    chunk->used = 0;
+    arena->head = chunk;
+}
+
+void arena_release(arena_t *arena) {
+    arena_chunk_t *chunk = arena->head;
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
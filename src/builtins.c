@@ -1,14 +1,31 @@
 #define _GNU_SOURCE
 #include "builtins.h"
+#include "alias.h"
+#include "cmdcache.h"
+#include "cmdhash.h"
+#include "history.h"
+#include "histsearch.h"
+#include "jobs.h"
+#include "metrics.h"
+#include "trace.h"
+#include "options.h"
+#include "prompt.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+static int exit_code = -1;
+
+int builtin_exit_code(void) {
+    return exit_code;
+}
+
 int is_builtin(const char *cmd) {
     if (!cmd || *cmd == '\0') return 0;
     static const char *builtins[] = {
-        "cd", "exit", "alias", "unalias", "history", "jobs", "fg", "bg", "help", NULL
+        "cd", "exit", "alias", "unalias", "history", "jobs", "fg", "bg", "help", "hash",
+        "set", "pipestatus", "cmdcache", "metrics", "trace", NULL
     };
     for (int i = 0; builtins[i] != NULL; i++) {
         if (strcmp(cmd, builtins[i]) == 0) return 1;
@@ -19,23 +36,289 @@ int is_builtin(const char *cmd) {
 static void print_help() {
     puts("kali-shell builtin commands:");
     puts("  cd [dir]       Change current directory");
-    puts("  exit           Exit shell");
+    puts("  exit [n]       Exit shell with status n");
+    puts("  alias [name[=value]...]  Define or show aliases");
+    puts("  unalias [-a] name...  Remove aliases (-a: all of them)");
+    puts("  hash [-r] [name...]  Show, fill or reset the command path cache");
+    puts("  history [n]    List history (last n entries)");
+    puts("  history search <pattern>  Ranked history matches");
+    puts("  jobs           List background and stopped jobs");
+    puts("  fg [%n]        Resume a job in the foreground");
+    puts("  bg [%n]        Resume a stopped job in the background");
+    puts("  set [-o|+o name]  Show or toggle shell options (pipefail, zerocopy)");
+    puts("  pipestatus     Exit status of each stage of the last pipeline");
+    puts("  cmdcache [-c]  Show parsed-line cache counters (-c: empty the cache)");
+    puts("  metrics [on [file]|off|-c|dump file]  Per-command latency percentiles (file: Prometheus dump on exit)");
+    puts("  trace [on|off|-c|dump file]  Record shell events in a ring buffer; dump as JSON lines");
+    puts("  time [-j] pipeline  Run pipeline, then show each stage's time and resource usage");
+    puts("  parallel [-j N] [-k|-u] cmd [args] [::: items]  Run cmd per item ({}), N at a time");
     puts("  help           Show this help");
 }
 
+// hash: list cached command paths, -r to forget them all, or look up names
+static int builtin_hash(command_t *cmd) {
+    if (cmd->argc < 2) {
+        cmdhash_print();
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; i < cmd->argc; i++) {
+        if (strcmp(cmd->argv[i], "-r") == 0) {
+            cmdhash_clear();
+        } else if (!cmdhash_lookup(cmd->argv[i]) && !strchr(cmd->argv[i], '/')) {
+            fprintf(stderr, "hash: %s: not found\n", cmd->argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+#define HISTORY_SEARCH_MAX 50
+
+// history [n] | history search <pattern>
+static int builtin_history(command_t *cmd) {
+    if (cmd->argc >= 2 && strcmp(cmd->argv[1], "search") == 0) {
+        if (cmd->argc < 3) {
+            fprintf(stderr, "history: search: missing pattern\n");
+            return 1;
+        }
+        // Words after "search" form one pattern
+        char pattern[1024] = {0};
+        size_t used = 0;
+        for (int i = 2; i < cmd->argc && used + 1 < sizeof(pattern); i++) {
+            int n = snprintf(pattern + used, sizeof(pattern) - used, "%s%s", i > 2 ? " " : "", cmd->argv[i]);
+            if (n < 0) break;
+            used += (size_t)n;
+        }
+        if (used >= sizeof(pattern)) used = sizeof(pattern) - 1;
+
+        hist_match_t matches[HISTORY_SEARCH_MAX];
+        size_t found = histsearch_find(pattern, matches, HISTORY_SEARCH_MAX);
+        for (size_t i = 0; i < found; i++)
+            printf("%5zu  %s\n", matches[i].number + 1, matches[i].line);
+        return 0;
+    }
+
+    size_t len = history_len();
+    size_t start = 0;
+    if (cmd->argc >= 2) {
+        char *end;
+        unsigned long n = strtoul(cmd->argv[1], &end, 10);
+        if (*cmd->argv[1] == '\0' || *end != '\0') {
+            fprintf(stderr, "history: %s: numeric argument required\n", cmd->argv[1]);
+            return 1;
+        }
+        if (n < len) start = len - n;
+    }
+    size_t first = history_first();
+    for (size_t i = start; i < len; i++)
+        printf("%5zu  %s\n", first + i + 1, history_at(i));
+    return 0;
+}
+
+// fg/bg [job]: resume a job in the foreground or the background. fg
+// returns the job's status
+static int builtin_fg_bg(command_t *cmd, int foreground) {
+    const char *name = cmd->argv[0];
+    if (!jobs_control_enabled()) {
+        fprintf(stderr, "%s: no job control\n", name);
+        return 1;
+    }
+    jobs_reap();
+    const char *spec = cmd->argc >= 2 ? cmd->argv[1] : NULL;
+    job_t *job = job_find(spec);
+    if (!job) {
+        fprintf(stderr, "%s: %s: no such job\n", name, spec ? spec : "current");
+        return 1;
+    }
+    if (foreground) {
+        printf("%s\n", job->command);
+        fflush(stdout);
+        return job_wait_foreground(job, 1);
+    }
+    job_run_background(job, 1);
+    return 0;
+}
+
+// set [-o|+o option]...: -o enables, +o disables, no option lists them
+static int builtin_set(command_t *cmd) {
+    if (cmd->argc < 2) {
+        options_print();
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; i < cmd->argc; i++) {
+        const char *flag = cmd->argv[i];
+        if (strcmp(flag, "-o") != 0 && strcmp(flag, "+o") != 0) {
+            fprintf(stderr, "set: %s: invalid option\n", flag);
+            return 1;
+        }
+        if (i + 1 >= cmd->argc) {
+            options_print();
+            return status;
+        }
+        const char *name = cmd->argv[++i];
+        if (option_set(name, flag[0] == '-') == -1) {
+            fprintf(stderr, "set: %s: invalid option name\n", name);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// alias: list every alias, show the named ones, or define name=value
+static int builtin_alias(command_t *cmd) {
+    if (cmd->argc < 2) {
+        alias_print(NULL);
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; i < cmd->argc; i++) {
+        const char *eq = strchr(cmd->argv[i], '=');
+        if (!eq) {
+            if (alias_print(cmd->argv[i]) == -1) {
+                fprintf(stderr, "alias: %s: not found\n", cmd->argv[i]);
+                status = 1;
+            }
+            continue;
+        }
+        if (eq == cmd->argv[i]) {
+            fprintf(stderr, "alias: %s: invalid alias name\n", cmd->argv[i]);
+            status = 1;
+            continue;
+        }
+        // argv may belong to a cached parse, which is read-only
+        char *name = strndup(cmd->argv[i], (size_t)(eq - cmd->argv[i]));
+        if (!name || alias_set(name, eq + 1, 0) == -1) {
+            perror("alias");
+            status = 1;
+        }
+        free(name);
+    }
+    return status;
+}
+
+static int builtin_unalias(command_t *cmd) {
+    if (cmd->argc < 2) {
+        fprintf(stderr, "unalias: usage: unalias [-a] name...\n");
+        return 1;
+    }
+    if (strcmp(cmd->argv[1], "-a") == 0) {
+        alias_clear();
+        return 0;
+    }
+    int status = 0;
+    for (int i = 1; i < cmd->argc; i++) {
+        if (alias_unset(cmd->argv[i]) == -1) {
+            fprintf(stderr, "unalias: %s: not found\n", cmd->argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static void builtin_pipestatus(void) {
+    const int *statuses;
+    size_t count = jobs_pipestatus(&statuses);
+    for (size_t i = 0; i < count; i++)
+        printf("%s%d", i ? " " : "", statuses[i]);
+    printf("\n");
+}
+
+// metrics [on [file]|off|-c|dump file]
+static int builtin_metrics(command_t *cmd) {
+    const char *arg = cmd->argc >= 2 ? cmd->argv[1] : NULL;
+    if (!arg) {
+        metrics_print();
+    } else if (strcmp(arg, "on") == 0 && cmd->argc <= 3) {
+        metrics_start(cmd->argc == 3 ? cmd->argv[2] : NULL);
+    } else if (strcmp(arg, "off") == 0 && cmd->argc == 2) {
+        metrics_stop();
+    } else if (strcmp(arg, "-c") == 0 && cmd->argc == 2) {
+        metrics_reset();
+    } else if (strcmp(arg, "dump") == 0 && cmd->argc == 3) {
+        return metrics_dump(cmd->argv[2]) == -1;
+    } else {
+        fprintf(stderr, "usage: metrics [on [file]|off|-c|dump file]\n");
+        return 1;
+    }
+    return 0;
+}
+
+// trace [on|off|-c|dump file]
+static int builtin_trace(command_t *cmd) {
+    const char *arg = cmd->argc >= 2 ? cmd->argv[1] : NULL;
+    if (!arg) {
+        trace_print();
+    } else if (strcmp(arg, "on") == 0 && cmd->argc == 2) {
+        trace_start();
+    } else if (strcmp(arg, "off") == 0 && cmd->argc == 2) {
+        trace_stop();
+    } else if (strcmp(arg, "-c") == 0 && cmd->argc == 2) {
+        trace_clear();
+    } else if (strcmp(arg, "dump") == 0 && cmd->argc == 3) {
+        return trace_dump(cmd->argv[2]) == -1;
+    } else {
+        fprintf(stderr, "usage: trace [on|off|-c|dump file]\n");
+        return 1;
+    }
+    return 0;
+}
+
 int builtin_execute(command_t *cmd) {
     if (!cmd || !cmd->argv || !cmd->argv[0]) return SHELL_OK;
 
     if (strcmp(cmd->argv[0], "exit") == 0) {
+        if (cmd->argc >= 2) {
+            char *end;
+            long code = strtol(cmd->argv[1], &end, 10);
+            if (*cmd->argv[1] == '\0' || *end != '\0') {
+                fprintf(stderr, "exit: %s: numeric argument required\n", cmd->argv[1]);
+                code = 2;
+            }
+            exit_code = (int)(code & 0xff);
+        }
         return SHELL_EXIT;
     } else if (strcmp(cmd->argv[0], "cd") == 0) {
         if (cmd->argc < 2) {
             fprintf(stderr, "cd: missing argument\n");
-            return SHELL_OK;
+            return 1;
         }
         if (chdir(cmd->argv[1]) != 0) {
             perror("cd");
+            return 1;
         }
+        prompt_invalidate_cwd();
+        return SHELL_OK;
+    } else if (strcmp(cmd->argv[0], "history") == 0) {
+        return builtin_history(cmd);
+    } else if (strcmp(cmd->argv[0], "hash") == 0) {
+        return builtin_hash(cmd);
+    } else if (strcmp(cmd->argv[0], "jobs") == 0) {
+        jobs_print();
+        return SHELL_OK;
+    } else if (strcmp(cmd->argv[0], "fg") == 0) {
+        return builtin_fg_bg(cmd, 1);
+    } else if (strcmp(cmd->argv[0], "bg") == 0) {
+        return builtin_fg_bg(cmd, 0);
+    } else if (strcmp(cmd->argv[0], "set") == 0) {
+        return builtin_set(cmd);
+    } else if (strcmp(cmd->argv[0], "alias") == 0) {
+        return builtin_alias(cmd);
+    } else if (strcmp(cmd->argv[0], "unalias") == 0) {
+        return builtin_unalias(cmd);
+    } else if (strcmp(cmd->argv[0], "cmdcache") == 0) {
+        if (cmd->argc >= 2 && strcmp(cmd->argv[1], "-c") == 0)
+            cmdcache_clear();
+        else
+            cmdcache_print();
+        return SHELL_OK;
+    } else if (strcmp(cmd->argv[0], "metrics") == 0) {
+        return builtin_metrics(cmd);
+    } else if (strcmp(cmd->argv[0], "trace") == 0) {
+        return builtin_trace(cmd);
+    } else if (strcmp(cmd->argv[0], "pipestatus") == 0) {
+        builtin_pipestatus();
         return SHELL_OK;
     } else if (strcmp(cmd->argv[0], "help") == 0) {
         print_help();
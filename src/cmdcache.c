@@ -0,0 +1,183 @@
+// src/cmdcache.c
+#define _GNU_SOURCE
+#include "cmdcache.h"
+#include "alias.h"
+#include "cmdhash.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CMDCACHE_LINES 64         // Lines kept; the least recently used goes first
+#define CMDCACHE_BUCKETS 128
+#define CMDCACHE_LINE_MAX 4096    // Longer lines are parsed but not kept
+
+typedef struct cache_entry {
+    char *line;                   // Key: the line as typed (trimmed)
+    size_t hash;
+    command_list_t *cmdlist;      // Holds one reference for the cache
+    unsigned long alias_gen;      // alias_generation() it was expanded with
+    unsigned long path_gen;       // cmdhash_generation() its paths came from
+    struct cache_entry *chain;    // Next entry in the same bucket
+    struct cache_entry *newer;
+    struct cache_entry *older;
+} cache_entry_t;
+
+static cache_entry_t *buckets[CMDCACHE_BUCKETS];
+static cache_entry_t *newest = NULL;
+static cache_entry_t *oldest = NULL;
+static size_t entry_count = 0;
+
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static unsigned long evictions = 0;
+
+// FNV-1a
+static size_t hash_line(const char *s) {
+    size_t h = 14695981039346656037ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static cache_entry_t *find(const char *line, size_t hash) {
+    for (cache_entry_t *e = buckets[hash % CMDCACHE_BUCKETS]; e; e = e->chain) {
+        if (e->hash == hash && strcmp(e->line, line) == 0) return e;
+    }
+    return NULL;
+}
+
+static void unlink_lru(cache_entry_t *e) {
+    if (e->newer) e->newer->older = e->older; else newest = e->older;
+    if (e->older) e->older->newer = e->newer; else oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void push_newest(cache_entry_t *e) {
+    e->older = newest;
+    e->newer = NULL;
+    if (newest) newest->newer = e;
+    newest = e;
+    if (!oldest) oldest = e;
+}
+
+static void drop_entry(cache_entry_t *e) {
+    cache_entry_t **link = &buckets[e->hash % CMDCACHE_BUCKETS];
+    while (*link != e) link = &(*link)->chain;
+    *link = e->chain;
+    unlink_lru(e);
+    cmdcache_release(e->cmdlist);
+    free(e->line);
+    free(e);
+    entry_count--;
+}
+
+// Resolve each stage's command now, so running the line again needs no
+// $PATH lookup. Builtins and names with a '/' are left to the executor.
+// The paths are copied into the list: a builtin on the same line may clear
+// the command hash before the stage runs.
+static void resolve_paths(command_list_t *cmdlist) {
+    for (size_t i = 0; i < cmdlist->pipeline_count; i++) {
+        const pipeline_t *p = cmdlist->pipelines[i];
+        for (size_t j = 0; j < p->count; j++) {
+            command_t *cmd = p->commands[j];
+            const char *name = cmd->argv[0];
+            const char *path = (name && !is_builtin(name)) ? cmdhash_lookup(name) : NULL;
+            if (cmd->path && path && strcmp(cmd->path, path) == 0) continue;
+            cmd->path = path ? arena_strdup(&cmdlist->arena, path) : NULL;
+        }
+    }
+}
+
+static command_list_t *build(const char *line) {
+    command_list_t *cmdlist = parse_input(line);
+    if (!cmdlist) return NULL;
+    if (alias_expand(cmdlist) == -1) {
+        command_list_free(cmdlist);
+        return NULL;
+    }
+    resolve_paths(cmdlist);
+    cmdlist->refs = 1;
+    return cmdlist;
+}
+
+static void trace_parse(trace_kind_t kind, const command_list_t *cmdlist, long long started) {
+    const char *first = NULL;
+    if (cmdlist && cmdlist->pipeline_count > 0 && cmdlist->pipelines[0]->count > 0)
+        first = cmdlist->pipelines[0]->commands[0]->argv[0];
+    trace_record(kind, cmdlist ? (long long)cmdlist->pipeline_count : -1, trace_now() - started, first);
+}
+
+command_list_t *cmdcache_get(const char *line) {
+    if (!line) return NULL;
+    long long started = trace_active ? trace_now() : 0;
+    size_t hash = hash_line(line);
+    cache_entry_t *e = find(line, hash);
+
+    // An alias change can alter the parse
+    if (e && e->alias_gen != alias_generation()) {
+        drop_entry(e);
+        e = NULL;
+    }
+
+    if (e) {
+        hits++;
+        // A path was dropped or $PATH changed: look the commands up again
+        if (e->path_gen != cmdhash_generation()) {
+            resolve_paths(e->cmdlist);
+            e->path_gen = cmdhash_generation();
+        }
+        unlink_lru(e);
+        push_newest(e);
+        e->cmdlist->refs++;
+        if (trace_active) trace_parse(TRACE_CACHE_HIT, e->cmdlist, started);
+        return e->cmdlist;
+    }
+
+    misses++;
+    command_list_t *cmdlist = build(line);
+    if (trace_active) trace_parse(TRACE_PARSE, cmdlist, started);
+    if (!cmdlist || strlen(line) > CMDCACHE_LINE_MAX) return cmdlist;
+
+    e = calloc(1, sizeof(cache_entry_t));
+    if (!e) return cmdlist;
+    if (!(e->line = strdup(line))) {
+        free(e);
+        return cmdlist;
+    }
+    if (entry_count == CMDCACHE_LINES) {
+        drop_entry(oldest);
+        evictions++;
+    }
+    e->hash = hash;
+    e->cmdlist = cmdlist;
+    e->alias_gen = alias_generation();
+    e->path_gen = cmdhash_generation();
+    e->chain = buckets[hash % CMDCACHE_BUCKETS];
+    buckets[hash % CMDCACHE_BUCKETS] = e;
+    push_newest(e);
+    entry_count++;
+    cmdlist->refs++;
+    return cmdlist;
+}
+
+void cmdcache_release(command_list_t *cmdlist) {
+    if (cmdlist && --cmdlist->refs <= 0) command_list_free(cmdlist);
+}
+
+void cmdcache_clear(void) {
+    while (oldest) drop_entry(oldest);
+}
+
+void cmdcache_print(void) {
+    unsigned long lookups = hits + misses;
+    printf("hits\tmisses\tevicted\tlines\n");
+    printf("%lu\t%lu\t%lu\t%zu/%d\n", hits, misses, evictions, entry_count, CMDCACHE_LINES);
+    if (lookups) printf("hit rate: %.1f%%\n", 100.0 * hits / lookups);
+}
+
+void cmdcache_free(void) {
+    cmdcache_clear();
+}
@@ -0,0 +1,193 @@
+// src/cmdhash.c
+#define _GNU_SOURCE
+#include "cmdhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CMDHASH_INITIAL_CAP 64
+
+typedef struct cmdhash_entry {
+    char *name;                   // Command name (key), NULL if slot empty
+    char *path;                   // Resolved absolute path
+    unsigned long hits;           // Number of lookups served
+    int deleted;                  // Tombstone left by cmdhash_forget
+} cmdhash_entry_t;
+
+static cmdhash_entry_t *table = NULL;
+static size_t table_cap = 0;
+static size_t table_used = 0;     // Live entries plus tombstones
+static char *table_path = NULL;   // $PATH the entries were resolved against
+static unsigned long generation = 0;
+
+// FNV-1a
+static size_t hash_name(const char *s) {
+    size_t h = 14695981039346656037ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void free_entries(void) {
+    for (size_t i = 0; i < table_cap; i++) {
+        free(table[i].name);
+        free(table[i].path);
+    }
+    free(table);
+    table = NULL;
+    table_cap = 0;
+    table_used = 0;
+}
+
+// Find the slot holding name, or NULL
+static cmdhash_entry_t *find(const char *name) {
+    if (table_cap == 0) return NULL;
+    size_t mask = table_cap - 1;
+    for (size_t i = hash_name(name) & mask;; i = (i + 1) & mask) {
+        cmdhash_entry_t *e = &table[i];
+        if (!e->name && !e->deleted) return NULL;
+        if (e->name && strcmp(e->name, name) == 0) return e;
+    }
+}
+
+static int grow(void) {
+    size_t new_cap = table_cap ? table_cap * 2 : CMDHASH_INITIAL_CAP;
+    cmdhash_entry_t *new_table = calloc(new_cap, sizeof(cmdhash_entry_t));
+    if (!new_table) return -1;
+
+    size_t live = 0;
+    for (size_t i = 0; i < table_cap; i++) {
+        if (!table[i].name) continue;
+        size_t j = hash_name(table[i].name) & (new_cap - 1);
+        while (new_table[j].name) j = (j + 1) & (new_cap - 1);
+        new_table[j] = table[i];
+        live++;
+    }
+    free(table);
+    table = new_table;
+    table_cap = new_cap;
+    table_used = live;
+    return 0;
+}
+
+static cmdhash_entry_t *insert(const char *name, char *path) {
+    if ((table_used + 1) * 4 > table_cap * 3 && grow() != 0)
+        return NULL;
+
+    size_t mask = table_cap - 1;
+    size_t i = hash_name(name) & mask;
+    while (table[i].name) i = (i + 1) & mask;
+
+    cmdhash_entry_t *e = &table[i];
+    e->name = strdup(name);
+    if (!e->name) return NULL;
+    if (!e->deleted) table_used++;
+    e->path = path;
+    e->hits = 0;
+    e->deleted = 0;
+    return e;
+}
+
+// Walk $PATH the way execvp would; returns malloc'ed path or NULL
+static char *resolve(const char *name, const char *path_env) {
+    size_t name_len = strlen(name);
+    const char *dir = path_env;
+
+    for (;;) {
+        const char *end = strchrnul(dir, ':');
+        size_t dir_len = (size_t)(end - dir);
+        char *full = malloc(dir_len + name_len + 3);
+        if (!full) return NULL;
+
+        // An empty PATH component means the current directory
+        if (dir_len == 0) {
+            memcpy(full, ".", 1);
+            dir_len = 1;
+        } else {
+            memcpy(full, dir, dir_len);
+        }
+        full[dir_len] = '/';
+        memcpy(full + dir_len + 1, name, name_len + 1);
+
+        struct stat st;
+        if (stat(full, &st) == 0 && S_ISREG(st.st_mode) && access(full, X_OK) == 0)
+            return full;
+        free(full);
+
+        if (*end == '\0') return NULL;
+        dir = end + 1;
+    }
+}
+
+// Drop the table if $PATH changed since it was filled
+static void check_path(const char *path_env) {
+    if (table_path && strcmp(table_path, path_env) == 0)
+        return;
+    cmdhash_clear();
+    table_path = strdup(path_env);
+}
+
+static const char *current_path(void) {
+    const char *path_env = getenv("PATH");
+    if (!path_env) path_env = CMDHASH_DEFAULT_PATH;
+    check_path(path_env);
+    return path_env;
+}
+
+const char *cmdhash_lookup(const char *name) {
+    if (!name || !*name || strchr(name, '/')) return NULL;
+
+    const char *path_env = current_path();
+
+    cmdhash_entry_t *e = find(name);
+    if (!e) {
+        char *path = resolve(name, path_env);
+        if (!path) return NULL;
+        e = insert(name, path);
+        if (!e) {
+            free(path);
+            return NULL;
+        }
+    }
+    e->hits++;
+    return e->path;
+}
+
+void cmdhash_forget(const char *name) {
+    if (!name) return;
+    cmdhash_entry_t *e = find(name);
+    if (!e) return;
+    free(e->name);
+    free(e->path);
+    e->name = NULL;
+    e->path = NULL;
+    e->deleted = 1;
+    generation++;
+}
+
+void cmdhash_clear(void) {
+    free_entries();
+    free(table_path);
+    table_path = NULL;
+    generation++;
+}
+
+unsigned long cmdhash_generation(void) {
+    current_path();
+    return generation;
+}
+
+void cmdhash_print(void) {
+    int any = 0;
+    for (size_t i = 0; i < table_cap; i++) {
+        if (!table[i].name) continue;
+        if (!any) puts("hits\tcommand");
+        printf("%4lu\t%s\n", table[i].hits, table[i].path);
+        any = 1;
+    }
+    if (!any) puts("hash: hash table empty");
+}
@@ -4,10 +4,20 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 #include "config.h"
+#include "history.h"
+#include "alias.h"
 
 #define CONFIG_PATH ".kali_shellrc"
-#define LINE_MAX 512
+#define CONFIG_LINE_MAX 512
+
+// The file as last loaded, to tell whether it changed
+static struct stat loaded_st;
+static int loaded_exists = 0;
+static int watch_fd = -1;         // inotify on $HOME, -1 to compare stat()
 
 static char *trim_whitespace(char *str) {
     if (!str) return NULL;
@@ -24,21 +34,55 @@ void config_init(shell_config_t *config) {
     strncpy(config->prompt_format, "\\u@\\h:\\w\\$ ", PROMPT_MAX_LEN - 1);
     config->prompt_format[PROMPT_MAX_LEN - 1] = '\0';
     config->theme = THEME_DEFAULT;
+    config->history_size = HISTORY_DEFAULT_SIZE;
+    config->history_flush = 1;
+}
+
+static int config_path(char *path, size_t size) {
+    const char *home = getenv("HOME");
+    if (!home) return -1;
+    snprintf(path, size, "%s/%s", home, CONFIG_PATH);
+    return 0;
+}
+
+static int same_file(const struct stat *a, const struct stat *b) {
+    return a->st_ino == b->st_ino && a->st_dev == b->st_dev && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+// alias name=value, the value optionally quoted
+static void parse_alias(char *def) {
+    char *eq = strchr(def, '=');
+    if (!eq) return;
+
+    *eq = '\0';
+    char *name = trim_whitespace(def);
+    char *value = trim_whitespace(eq + 1);
+
+    size_t len = strlen(value);
+    if (len >= 2 && ((value[0] == '\'' && value[len - 1] == '\'') ||
+                     (value[0] == '"' && value[len - 1] == '"'))) {
+        value[len - 1] = '\0';
+        value++;
+    }
+    if (*name) alias_set(name, value, 1);
 }
 
 int config_load(shell_config_t *config) {
     if (!config) return -1;
 
-    char path[512];
-    char *home = getenv("HOME");
-    if (!home) return -1;
+    // Aliases the file defined last time go away if it no longer does
+    alias_clear_config();
+    loaded_exists = 0;
 
-    snprintf(path, sizeof(path), "%s/%s", home, CONFIG_PATH);
+    char path[PATH_MAX];
+    if (config_path(path, sizeof(path)) == -1) return -1;
 
     FILE *f = fopen(path, "r");
     if (!f) return -1;
+    loaded_exists = fstat(fileno(f), &loaded_st) == 0;
 
-    char line[LINE_MAX];
+    char line[CONFIG_LINE_MAX];
     while (fgets(line, sizeof(line), f)) {
         char *trimline = trim_whitespace(line);
 
@@ -57,10 +101,65 @@ int config_load(shell_config_t *config) {
             } else if (strcmp(value, "light") == 0) {
                 config->theme = THEME_LIGHT;
             }
+        } else if (strncmp(trimline, "histsize=", 9) == 0) {
+            char *value = trim_whitespace(trimline + 9);
+            char *end;
+            unsigned long size = strtoul(value, &end, 10);
+            if (*value && *end == '\0' && size > 0) {
+                config->history_size = size;
+            }
+        } else if (strncmp(trimline, "histflush=", 10) == 0) {
+            char *value = trim_whitespace(trimline + 10);
+            char *end;
+            unsigned long lines = strtoul(value, &end, 10);
+            if (*value && *end == '\0' && lines > 0) {
+                config->history_flush = lines;
+            }
+        } else if (strncmp(trimline, "alias ", 6) == 0) {
+            parse_alias(trimline + 6);
         }
-        // Alias lines handled in main.c
     }
 
     fclose(f);
     return 0;
 }
+
+int config_watch(void) {
+    if (watch_fd != -1) return watch_fd;
+    const char *home = getenv("HOME");
+    if (!home) return -1;
+
+    // The directory, not the file: editors often save by renaming a new
+    // copy over it, which would end a watch on the file itself
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd == -1) return -1;
+    if (inotify_add_watch(watch_fd, home, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE |
+                                          IN_MOVED_FROM) == -1) {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+    return watch_fd;
+}
+
+int config_changed(void) {
+    if (watch_fd != -1) {
+        int changed = 0;
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t n;
+        while ((n = read(watch_fd, buf, sizeof(buf))) > 0) {
+            for (char *p = buf; p < buf + n;) {
+                const struct inotify_event *ev = (const struct inotify_event *)p;
+                if (ev->len && strcmp(ev->name, CONFIG_PATH) == 0) changed = 1;
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
+        return changed;
+    }
+
+    char path[PATH_MAX];
+    struct stat st;
+    if (config_path(path, sizeof(path)) == -1) return 0;
+    int exists = stat(path, &st) == 0;
+    if (exists != loaded_exists) return 1;
+    return exists && !same_file(&st, &loaded_st);
+}
@@ -0,0 +1,362 @@
+// src/datapump.c
+#define _GNU_SOURCE
+#include "datapump.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+// Bytes per call, small enough to notice SIGINT promptly
+#define PUMP_CHUNK (16 << 20)
+#define PUMP_BUF_SIZE (128 << 10)
+
+typedef enum {
+    PUMP_COPY_FILE_RANGE,
+    PUMP_SENDFILE,
+    PUMP_SPLICE,
+    PUMP_READ_WRITE
+} pump_method_t;
+
+// Foreground pump threads keep every signal blocked but PUMP_WAKE_SIGNAL.
+// Ctrl-C reaches the main thread, which passes it on to each of them, so a
+// thread stuck in open(), read() or splice() on a fifo gets EINTR.
+#define PUMP_WAKE_SIGNAL SIGRTMIN
+#define PUMP_THREADS_MAX 64
+
+static volatile sig_atomic_t interrupted = 0;
+static _Thread_local int detached = 0;
+static _Thread_local int thread_slot = -1;
+static struct sigaction saved_int;
+static sigset_t saved_mask;
+
+static pthread_t pump_threads[PUMP_THREADS_MAX];
+static int pump_live[PUMP_THREADS_MAX];  // Slot holds a running pump thread
+
+#define STOPPED() (interrupted && !detached)
+
+static void wake_threads(void) {
+    for (int i = 0; i < PUMP_THREADS_MAX; i++) {
+        if (__atomic_load_n(&pump_live[i], __ATOMIC_ACQUIRE) == 1)
+            pthread_kill(pump_threads[i], PUMP_WAKE_SIGNAL);
+    }
+}
+
+static void pump_sigint(int signo) {
+    (void)signo;
+    interrupted = 1;
+    wake_threads();
+}
+
+static void pump_wake(int signo) {
+    (void)signo;
+}
+
+void datapump_thread_begin(void) {
+    if (detached) return;
+    // 0 free, 2 being filled in, 1 live
+    for (int i = 0; i < PUMP_THREADS_MAX && thread_slot == -1; i++) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&pump_live[i], &expected, 2, 0, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            pump_threads[i] = pthread_self();
+            __atomic_store_n(&pump_live[i], 1, __ATOMIC_RELEASE);
+            thread_slot = i;
+        }
+    }
+    sigset_t wake;
+    sigemptyset(&wake);
+    sigaddset(&wake, PUMP_WAKE_SIGNAL);
+    pthread_sigmask(SIG_UNBLOCK, &wake, NULL);
+}
+
+void datapump_thread_end(void) {
+    if (thread_slot == -1) return;
+    sigset_t wake;
+    sigemptyset(&wake);
+    sigaddset(&wake, PUMP_WAKE_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &wake, NULL);
+    __atomic_store_n(&pump_live[thread_slot], 0, __ATOMIC_RELEASE);
+    thread_slot = -1;
+}
+
+void datapump_kick(void) {
+    if (interrupted) wake_threads();
+}
+
+void datapump_begin(void) {
+    struct sigaction sa = {0};
+    sigemptyset(&sa.sa_mask);
+    // No SA_RESTART: a blocked read or write returns EINTR
+    sa.sa_handler = pump_sigint;
+    sigaction(SIGINT, &sa, &saved_int);
+    interrupted = 0;
+
+    // Installed for good: only ever sent to pump threads by the shell
+    static int wake_installed = 0;
+    if (!wake_installed) {
+        sa.sa_handler = pump_wake;
+        sigaction(PUMP_WAKE_SIGNAL, &sa, NULL);
+        wake_installed = 1;
+    }
+
+    // The interactive shell keeps SIGINT blocked for its signalfd
+    sigset_t sigint;
+    sigemptyset(&sigint);
+    sigaddset(&sigint, SIGINT);
+    pthread_sigmask(SIG_UNBLOCK, &sigint, &saved_mask);
+}
+
+void datapump_end(void) {
+    pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+    sigaction(SIGINT, &saved_int, NULL);
+}
+
+void datapump_detach(void) {
+    detached = 1;
+}
+
+int datapump_interrupted(void) {
+    return STOPPED();
+}
+
+// Errors that mean "not for this fd pair", as opposed to a failed copy
+static int unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EBADF;
+}
+
+static pump_method_t first_method(int in_fd, int out_fd) {
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) == -1 || fstat(out_fd, &out_st) == -1)
+        return PUMP_READ_WRITE;
+    if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode))
+        return PUMP_COPY_FILE_RANGE;
+    if (S_ISREG(in_st.st_mode) || S_ISBLK(in_st.st_mode))
+        return PUMP_SENDFILE;
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode))
+        return PUMP_SPLICE;
+    return PUMP_READ_WRITE;
+}
+
+// One read/write round; returns bytes moved like the syscalls above
+static ssize_t read_write(int in_fd, int out_fd, char *buf) {
+    ssize_t n = read(in_fd, buf, PUMP_BUF_SIZE);
+    if (n <= 0) return n;
+    for (ssize_t done = 0; done < n;) {
+        ssize_t w = write(out_fd, buf + done, (size_t)(n - done));
+        if (w == -1) {
+            if (errno == EINTR && !STOPPED()) continue;
+            return -1;
+        }
+        done += w;
+    }
+    return n;
+}
+
+int datapump_copy(int in_fd, int out_fd) {
+    pump_method_t method = first_method(in_fd, out_fd);
+    char *buf = NULL;
+
+    for (;;) {
+        if (STOPPED()) {
+            free(buf);
+            errno = EINTR;
+            return -1;
+        }
+
+        ssize_t n;
+        switch (method) {
+            case PUMP_COPY_FILE_RANGE:
+                n = copy_file_range(in_fd, NULL, out_fd, NULL, PUMP_CHUNK, 0);
+                break;
+            case PUMP_SENDFILE:
+                n = sendfile(out_fd, in_fd, NULL, PUMP_CHUNK);
+                break;
+            case PUMP_SPLICE:
+                n = splice(in_fd, NULL, out_fd, NULL, PUMP_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+                break;
+            default:
+                if (!buf && !(buf = malloc(PUMP_BUF_SIZE))) return -1;
+                n = read_write(in_fd, out_fd, buf);
+                break;
+        }
+
+        if (n == 0) break;
+        if (n > 0) continue;
+        if (errno == EINTR && !STOPPED()) continue;
+
+        // The kernel refused this pair: try the next method. All methods
+        // advance the fds' own offsets, so the next one resumes in place.
+        if (method != PUMP_READ_WRITE && unsupported(errno)) {
+            int in_pipe = 0, out_pipe = 0;
+            struct stat st;
+            if (fstat(in_fd, &st) == 0) in_pipe = S_ISFIFO(st.st_mode);
+            if (fstat(out_fd, &st) == 0) out_pipe = S_ISFIFO(st.st_mode);
+
+            if (method == PUMP_COPY_FILE_RANGE)
+                method = PUMP_SENDFILE;
+            else if (method == PUMP_SENDFILE && (in_pipe || out_pipe))
+                method = PUMP_SPLICE;
+            else
+                method = PUMP_READ_WRITE;
+            continue;
+        }
+
+        int err = errno;
+        free(buf);
+        errno = err;
+        return -1;
+    }
+
+    free(buf);
+    return 0;
+}
+
+// Move exactly len bytes out of pipe_fd into out_fd. Sinks splice refuses
+// (O_APPEND files on some kernels) get them through a buffer instead.
+static int splice_all(int pipe_fd, int out_fd, size_t len, char **buf) {
+    while (len > 0) {
+        ssize_t n = splice(pipe_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE);
+        if (n == -1 && errno == EINVAL) {
+            if (!*buf && !(*buf = malloc(PUMP_BUF_SIZE))) return -1;
+            n = read(pipe_fd, *buf, len < PUMP_BUF_SIZE ? len : PUMP_BUF_SIZE);
+            if (n > 0) {
+                for (ssize_t done = 0; done < n;) {
+                    ssize_t w = write(out_fd, *buf + done, (size_t)(n - done));
+                    if (w == -1) {
+                        if (errno == EINTR && !STOPPED()) continue;
+                        return -1;
+                    }
+                    done += w;
+                }
+            }
+        }
+        if (n == -1) {
+            if (errno == EINTR && !STOPPED()) continue;
+            return -1;
+        }
+        if (n == 0) {
+            errno = EIO;
+            return -1;
+        }
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Pipe input: each chunk is tee'd into a private pipe per sink (all but the
+// last) and spliced on, then the last sink consumes it from the input. The
+// private pipes are drained before every tee and are as large as the input
+// pipe, so each tee duplicates the whole chunk.
+// Returns 0, -1 on error, or 1 if tee(2) is unsupported before any data moved
+static int fanout_tee(int in_fd, const int *outs, size_t count) {
+    size_t ntmp = count - 1;
+    int (*tmp)[2] = calloc(ntmp, sizeof(*tmp));
+    if (!tmp) return -1;
+    for (size_t k = 0; k < ntmp; k++) tmp[k][0] = tmp[k][1] = -1;
+
+    int ret = -1;
+    char *buf = NULL;
+    int size = fcntl(in_fd, F_GETPIPE_SZ);
+    for (size_t k = 0; k < ntmp; k++) {
+        if (pipe2(tmp[k], O_CLOEXEC) == -1) goto out;
+        if (size > 0) fcntl(tmp[k][1], F_SETPIPE_SZ, size);
+    }
+
+    for (int first = 1;; first = 0) {
+        if (STOPPED()) {
+            errno = EINTR;
+            goto out;
+        }
+        ssize_t got = tee(in_fd, tmp[0][1], PUMP_CHUNK, 0);
+        if (got == 0) break;
+        if (got == -1) {
+            if (errno == EINTR && !STOPPED()) continue;
+            if (first && unsupported(errno)) ret = 1;
+            goto out;
+        }
+        for (size_t k = 1; k < ntmp; k++) {
+            ssize_t n = tee(in_fd, tmp[k][1], (size_t)got, 0);
+            if (n == -1 && errno == EINTR && !STOPPED()) {
+                k--;
+                continue;
+            }
+            if (n != got) {
+                if (n != -1) errno = EIO;
+                goto out;
+            }
+        }
+        for (size_t k = 0; k < ntmp; k++) {
+            if (splice_all(tmp[k][0], outs[k], (size_t)got, &buf) == -1) goto out;
+        }
+        if (splice_all(in_fd, outs[ntmp], (size_t)got, &buf) == -1) goto out;
+    }
+    ret = 0;
+
+out:;
+    int err = errno;
+    for (size_t k = 0; k < ntmp; k++) {
+        if (tmp[k][0] != -1) close(tmp[k][0]);
+        if (tmp[k][1] != -1) close(tmp[k][1]);
+    }
+    free(tmp);
+    free(buf);
+    errno = err;
+    return ret;
+}
+
+static int fanout_read_write(int in_fd, const int *outs, size_t count) {
+    char *buf = malloc(PUMP_BUF_SIZE);
+    if (!buf) return -1;
+
+    int ret = 0;
+    for (;;) {
+        if (STOPPED()) {
+            errno = EINTR;
+            ret = -1;
+            break;
+        }
+        ssize_t n = read(in_fd, buf, PUMP_BUF_SIZE);
+        if (n == 0) break;
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            ret = -1;
+            break;
+        }
+        for (size_t k = 0; k < count && ret == 0; k++) {
+            for (ssize_t done = 0; done < n;) {
+                ssize_t w = write(outs[k], buf + done, (size_t)(n - done));
+                if (w == -1) {
+                    if (errno == EINTR && !STOPPED()) continue;
+                    ret = -1;
+                    break;
+                }
+                done += w;
+            }
+        }
+        if (ret == -1) break;
+    }
+
+    int err = errno;
+    free(buf);
+    errno = err;
+    return ret;
+}
+
+int datapump_fanout(int in_fd, const int *outs, size_t count) {
+    if (count == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (count == 1) return datapump_copy(in_fd, outs[0]);
+
+    struct stat st;
+    if (fstat(in_fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        int ret = fanout_tee(in_fd, outs, count);
+        if (ret != 1) return ret;
+    }
+    return fanout_read_write(in_fd, outs, count);
+}
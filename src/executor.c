@@ -1,141 +1,703 @@
 // src/executor.c
 #define _GNU_SOURCE
 #include "executor.h"
+#include "builtins.h"
+#include "spawner.h"
+#include "cmdhash.h"
+#include "jobs.h"
+#include "options.h"
+#include "datapump.h"
+#include "parallel.h"
+#include "timecmd.h"
+#include "metrics.h"
+#include "trace.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <sys/wait.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
+#include <pthread.h>
 
-// Recursive helper to execute pipeline commands
-// cmd: current command_t node
-// input_fd: fd to use as standard input (or -1 for default)
-// Returns pid of last created child or -1 on error
-static pid_t exec_pipeline(command_t *cmd, int input_fd) {
-    if (!cmd) return -1;
+// Redirection files of one stage, -1 where absent
+typedef struct redir_fds {
+    int in;
+    int out;
+    int err;
+    int *more;                    // more_outputs of the command, in order
+    int more_count;
+} redir_fds_t;
 
-    int pipefd[2];
-    pid_t pid;
+// open() a redirection file. A fifo blocks until its other end is opened;
+// Ctrl-C gives up on it (EINTR, nothing printed)
+static int open_file(const char *file, int flags, const char *what) {
+    int fd;
+    do {
+        fd = open(file, flags, 0644);
+    } while (fd == -1 && errno == EINTR && !datapump_interrupted());
+    TRACE(TRACE_OPEN, fd, fd == -1 ? errno : 0, file);
+    if (fd == -1 && errno != EINTR)
+        fprintf(stderr, "cannot open %s file '%s': %s\n", what, file, strerror(errno));
+    return fd;
+}
+
+static int open_output(const char *file, int append) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    if (append)
+        flags |= O_APPEND;
+    else
+        flags |= O_TRUNC;
+    return open_file(file, flags, "output");
+}
+
+static void close_redirections(redir_fds_t *fds) {
+    if (fds->in != -1) close(fds->in);
+    if (fds->out != -1) close(fds->out);
+    if (fds->err != -1) close(fds->err);
+    for (int i = 0; i < fds->more_count; i++) close(fds->more[i]);
+    free(fds->more);
+    fds->in = fds->out = fds->err = -1;
+    fds->more = NULL;
+    fds->more_count = 0;
+}
 
-    // If there is a next pipe command, create pipe
-    int has_pipe = (cmd->pipe_to != NULL);
+// Open the redirection files of cmd in the parent. Files are opened
+// close-on-exec; the spawn engine dup2s them onto stdin/stdout/stderr in
+// the child. Returns 0 on success, -1 (with message printed) on failure.
+static int open_redirections(command_t *cmd, redir_fds_t *fds) {
+    fds->in = fds->out = fds->err = -1;
+    fds->more = NULL;
+    fds->more_count = 0;
 
-    if (has_pipe) {
-        if (pipe(pipefd) == -1) {
-            perror("pipe");
+    if (cmd->input_file) {
+        fds->in = open_file(cmd->input_file, O_RDONLY | O_CLOEXEC, "input");
+        if (fds->in == -1) return -1;
+    }
+
+    if (cmd->output_file) {
+        fds->out = open_output(cmd->output_file, cmd->append_output);
+        if (fds->out == -1) {
+            close_redirections(fds);
             return -1;
         }
     }
 
-    pid = fork();
-    if (pid == -1) {
-        perror("fork");
-        return -1;
+    if (cmd->more_output_count > 0) {
+        fds->more = malloc((size_t)cmd->more_output_count * sizeof(int));
+        if (!fds->more) {
+            perror("malloc");
+            close_redirections(fds);
+            return -1;
+        }
+        for (int i = 0; i < cmd->more_output_count; i++) {
+            int fd = open_output(cmd->more_outputs[i].file, cmd->more_outputs[i].append);
+            if (fd == -1) {
+                close_redirections(fds);
+                return -1;
+            }
+            fds->more[fds->more_count++] = fd;
+        }
+    }
+
+    if (cmd->error_file) {
+        fds->err = open_output(cmd->error_file, cmd->append_error);
+        if (fds->err == -1) {
+            close_redirections(fds);
+            return -1;
+        }
     }
+    return 0;
+}
 
-    if (pid == 0) {
-        // CHILD PROCESS
+// Start argv through the spawn engine. Bare command names are resolved via
+// the command hash (or come resolved from the command cache) and exec'd by
+// absolute path; a stale cached path is forgotten and resolved once more.
+static int spawn_command(command_t *cmd, spawn_req_t *req, pid_t *pid) {
+    const char *name = cmd->argv[0];
+    if (strchr(name, '/')) {
+        req->path = name;
+        return spawn_process(req, pid);
+    }
 
-        // If input_fd != -1, dup as stdin
-        if (input_fd != -1) {
-            if (dup2(input_fd, STDIN_FILENO) == -1) {
-                perror("dup2 stdin");
-                exit(EXIT_FAILURE);
-            }
-            close(input_fd);
+    req->path = cmd->path ? cmd->path : cmdhash_lookup(name);
+    if (!req->path) return ENOENT;
+
+    int err = spawn_process(req, pid);
+    if (err == ENOENT) {
+        cmdhash_forget(name);
+        req->path = cmdhash_lookup(name);
+        if (!req->path) return ENOENT;
+        err = spawn_process(req, pid);
+    }
+    return err;
+}
+
+// Work the shell does itself instead of launching a process. Pumps run on
+// their own threads, concurrently with the job's processes, and are joined
+// before the job is dropped.
+typedef enum {
+    PUMP_CAT,                     // cat [file...] stage
+    PUMP_TEE,                     // tee [-a] file... stage
+    PUMP_FANOUT,                  // stdout of a stage with several > targets
+    PUMP_PARALLEL                 // parallel stage, feeding its own workers
+} pump_kind_t;
+
+typedef struct pump {
+    pump_kind_t kind;
+    char **files;                 // cat's file arguments, copied since the
+    size_t nfiles;                // command line is freed before a
+                                  // background pump is done
+    parallel_t *parallel;         // Prepared parallel run, NULL if it failed
+    job_t *job;
+    size_t index;                 // Stage whose status a cat/tee pump sets
+    int status;                   // Preset by failures found while claiming
+    int detached;                 // Background job: SIGINT does not stop it
+    int in;                       // Owned fds, -1 where absent
+    int err;
+    int *outs;                    // Owned sinks
+    size_t nouts;
+} pump_t;
+
+typedef struct pump_list {
+    pump_t *items;
+    size_t count;
+    size_t cap;
+} pump_list_t;
+
+static pump_t *add_pump(pump_list_t *pumps, pump_kind_t kind, size_t nouts) {
+    if (pumps->count == pumps->cap) {
+        size_t cap = pumps->cap ? pumps->cap * 2 : 4;
+        pump_t *tmp = realloc(pumps->items, cap * sizeof(pump_t));
+        if (!tmp) return NULL;
+        pumps->items = tmp;
+        pumps->cap = cap;
+    }
+    int *outs = malloc(nouts * sizeof(int));
+    if (!outs) return NULL;
+    pump_t *pump = &pumps->items[pumps->count++];
+    memset(pump, 0, sizeof(*pump));
+    pump->kind = kind;
+    pump->in = pump->err = -1;
+    pump->outs = outs;
+    return pump;
+}
+
+static void close_pump(pump_t *pump) {
+    if (pump->in != -1) close(pump->in);
+    if (pump->err != -1) close(pump->err);
+    for (size_t k = 0; k < pump->nouts; k++) close(pump->outs[k]);
+    for (size_t k = 0; k < pump->nfiles; k++) free(pump->files[k]);
+    free(pump->outs);
+    free(pump->files);
+    parallel_free(pump->parallel);
+    pump->parallel = NULL;
+    pump->in = pump->err = -1;
+    pump->outs = NULL;
+    pump->files = NULL;
+    pump->nouts = pump->nfiles = 0;
+}
+
+// Drop the pump added last (claiming it failed)
+static void cancel_pump(pump_list_t *pumps) {
+    close_pump(&pumps->items[--pumps->count]);
+}
+
+static int add_sink(pump_t *pump, int fd) {
+    int dup = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dup == -1) return -1;
+    pump->outs[pump->nouts++] = dup;
+    return 0;
+}
+
+// Plain `cat [file...]` and `tee [-a] file...` only move bytes; parallel
+// always runs in the shell
+static int is_pump_command(command_t *cmd, pump_kind_t *kind) {
+    if (!cmd->argv[0]) return 0;
+    if (strcmp(cmd->argv[0], "parallel") == 0) {
+        *kind = PUMP_PARALLEL;
+        return 1;
+    }
+    if (!option_enabled(OPT_ZEROCOPY)) return 0;
+    int first = 1;
+    if (strcmp(cmd->argv[0], "cat") == 0) {
+        *kind = PUMP_CAT;
+    } else if (strcmp(cmd->argv[0], "tee") == 0) {
+        *kind = PUMP_TEE;
+        if (cmd->argc > 1 && strcmp(cmd->argv[1], "-a") == 0) first = 2;
+    } else {
+        return 0;
+    }
+    for (int i = first; i < cmd->argc; i++) {
+        if (cmd->argv[i][0] == '-') return 0;
+    }
+    return 1;
+}
+
+// Take over a pump stage's fds. A cat or tee reading a terminal (and for
+// cat, writing one) stays the real program, which the user can suspend.
+// A background parallel reading the terminal gets /dev/null instead: its
+// thread would otherwise take the lines typed at the prompt.
+// Returns 0, or -1 to launch it.
+static int claim_stage(pump_list_t *pumps, pump_kind_t kind, job_t *job, size_t i,
+                       command_t *cmd, redir_fds_t *files, int in_fd, int out, int foreground) {
+    int in = files->in != -1 ? files->in : (in_fd != -1 ? in_fd : STDIN_FILENO);
+    int err = files->err != -1 ? files->err : (cmd->pipe_stderr && out != STDOUT_FILENO ? out : STDERR_FILENO);
+    if (cmd->stderr_to_stdout && files->err == -1) err = out;
+    if (kind == PUMP_CAT && cmd->argc > 1) in = -1;
+    if (kind != PUMP_PARALLEL && ((in != -1 && isatty(in)) || (kind == PUMP_CAT && isatty(out))))
+        return -1;
+
+    int append = kind == PUMP_TEE && cmd->argc > 1 && strcmp(cmd->argv[1], "-a") == 0;
+    size_t nfiles = kind == PUMP_TEE ? (size_t)(cmd->argc - 1 - append) : 0;
+    pump_t *pump = add_pump(pumps, kind, nfiles + 1);
+    if (!pump) return -1;
+    pump->job = job;
+    pump->index = i;
+
+    if (kind == PUMP_CAT && cmd->argc > 1) {
+        pump->files = malloc((size_t)(cmd->argc - 1) * sizeof(char *));
+        for (int a = 1; pump->files && a < cmd->argc; a++) {
+            if (!(pump->files[pump->nfiles] = strdup(cmd->argv[a]))) break;
+            pump->nfiles++;
+        }
+        if (pump->nfiles != (size_t)(cmd->argc - 1)) {
+            cancel_pump(pumps);
+            return -1;
         }
+    }
 
-        // If piped to another command, redirect stdout to pipe write end
-        if (has_pipe) {
-            close(pipefd[0]); // close unused read end
-            if (dup2(pipefd[1], STDOUT_FILENO) == -1) {
-                perror("dup2 stdout");
-                exit(EXIT_FAILURE);
-            }
-            close(pipefd[1]);
+    if (kind == PUMP_PARALLEL && !foreground && in != -1 && isatty(in)) {
+        if ((pump->in = open("/dev/null", O_RDONLY | O_CLOEXEC)) == -1) {
+            cancel_pump(pumps);
+            return -1;
         }
+        in = -1;
+    }
+    if ((in != -1 && (pump->in = fcntl(in, F_DUPFD_CLOEXEC, 0)) == -1) ||
+        (pump->err = fcntl(err, F_DUPFD_CLOEXEC, 0)) == -1) {
+        cancel_pump(pumps);
+        return -1;
+    }
 
-        // Handle input redirection if any
-        if (cmd->input_file) {
-            int fd = open(cmd->input_file, O_RDONLY);
-            if (fd == -1) {
-                fprintf(stderr, "cannot open input file '%s': %s\n", cmd->input_file, strerror(errno));
-                exit(EXIT_FAILURE);
-            }
-            if (dup2(fd, STDIN_FILENO) == -1) {
-                perror("dup2 input file");
-                close(fd);
-                exit(EXIT_FAILURE);
-            }
-            close(fd);
+    // Usage errors are reported now; the stage then just fails
+    if (kind == PUMP_PARALLEL)
+        pump->parallel = parallel_prepare(cmd->argc, cmd->argv, pump->err, &pump->status);
+
+    // tee's files, then its stdout; a file that cannot be opened is
+    // reported and skipped, as tee does
+    for (int a = 1 + append; a < cmd->argc && kind == PUMP_TEE; a++) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        int fd = open(cmd->argv[a], flags, 0644);
+        if (fd == -1) {
+            dprintf(pump->err, "tee: %s: %s\n", cmd->argv[a], strerror(errno));
+            pump->status = 1;
+            continue;
         }
+        pump->outs[pump->nouts++] = fd;
+    }
+    if (add_sink(pump, out) == -1) {
+        cancel_pump(pumps);
+        return -1;
+    }
+    return 0;
+}
+
+// Route stdout of a stage with several > targets through a pipe that a
+// fan-out pump copies to all of them. Returns the fd the stage should write
+// to, or -1 on error.
+static int claim_fanout(pump_list_t *pumps, job_t *job, redir_fds_t *files, int *write_end) {
+    int fan[2];
+    if (pipe2(fan, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    // A larger pipe means fewer tee/splice rounds
+    fcntl(fan[1], F_SETPIPE_SZ, 1 << 20);
+
+    pump_t *pump = add_pump(pumps, PUMP_FANOUT, (size_t)files->more_count + 1);
+    if (!pump) {
+        close(fan[0]);
+        close(fan[1]);
+        return -1;
+    }
+    pump->job = job;
+    pump->in = fan[0];
+    pump->err = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    int ok = add_sink(pump, files->out) == 0;
+    for (int k = 0; ok && k < files->more_count; k++)
+        ok = add_sink(pump, files->more[k]) == 0;
+    if (!ok) {
+        cancel_pump(pumps);
+        close(fan[1]);
+        return -1;
+    }
+    *write_end = fan[1];
+    return fan[1];
+}
 
-        // Handle output redirection if any
-        if (cmd->output_file) {
-            int flags = O_WRONLY | O_CREAT;
-            if (cmd->append_output)
-                flags |= O_APPEND;
-            else
-                flags |= O_TRUNC;
+static void *pump_thread(void *arg) {
+    pump_t *pump = arg;
+    int status = pump->status;
+    if (pump->detached) datapump_detach();
+    datapump_thread_begin();
 
-            int fd = open(cmd->output_file, flags, 0644);
+    if (pump->kind == PUMP_CAT) {
+        // Each file argument in turn, or stdin, with cat's exit statuses
+        size_t count = pump->nfiles ? pump->nfiles : 1;
+        for (size_t i = 0; i < count; i++) {
+            const char *name = pump->nfiles ? pump->files[i] : "-";
+            int fd = pump->nfiles ? open(name, O_RDONLY | O_CLOEXEC) : pump->in;
+            // A fifo without a writer blocks the open until Ctrl-C
+            if (fd == -1 && errno == EINTR && datapump_interrupted()) {
+                status = 128 + SIGINT;
+                break;
+            }
             if (fd == -1) {
-                fprintf(stderr, "cannot open output file '%s': %s\n", cmd->output_file, strerror(errno));
-                exit(EXIT_FAILURE);
+                dprintf(pump->err, "cat: %s: %s\n", name, strerror(errno));
+                status = 1;
+                continue;
             }
-            if (dup2(fd, STDOUT_FILENO) == -1) {
-                perror("dup2 output file");
-                close(fd);
-                exit(EXIT_FAILURE);
+            int ret = datapump_copy(fd, pump->outs[0]);
+            int err = errno;
+            if (pump->nfiles) close(fd);
+            if (ret == 0) continue;
+
+            // A vanished reader or Ctrl-C ends cat like the signal would
+            if (err == EPIPE || err == EINTR) {
+                status = 128 + (err == EPIPE ? SIGPIPE : SIGINT);
+                break;
             }
-            close(fd);
+            dprintf(pump->err, "cat: %s: %s\n", name, strerror(err));
+            status = 1;
         }
+    } else if (pump->kind == PUMP_PARALLEL) {
+        if (pump->parallel)
+            status = parallel_run(pump->parallel, pump->in, pump->outs[0], pump->err, pump->detached,
+                                  pump->job->pgid);
+        pump->parallel = NULL;
+    } else if (datapump_fanout(pump->in, pump->outs, pump->nouts) == -1) {
+        int err = errno;
+        if (err == EPIPE || err == EINTR) {
+            status = 128 + (err == EPIPE ? SIGPIPE : SIGINT);
+        } else {
+            dprintf(pump->err, "%s: %s\n", pump->kind == PUMP_TEE ? "tee" : "kali_shell", strerror(err));
+            status = 1;
+        }
+    }
 
-        execvp(cmd->argv[0], cmd->argv);
-        fprintf(stderr, "exec failed: %s: %s\n", cmd->argv[0], strerror(errno));
-        exit(EXIT_FAILURE);
-    } else {
-        // PARENT PROCESS
+    datapump_thread_end();
+    if (pump->kind != PUMP_FANOUT) pump->job->procs[pump->index].status = status;
+    close_pump(pump);
+    job_thread_done(pump->job);
+    free(pump);
+    return NULL;
+}
+
+// Start every pump on its own thread, owned by the job. Signals stay
+// blocked on pump threads so SIGCHLD and SIGINT reach the main thread;
+// foreground pumps are woken with their own signal (datapump_thread_begin).
+static void start_pumps(job_t *job, pump_list_t *pumps, int background) {
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+
+    for (size_t i = 0; i < pumps->count; i++) {
+        pump_t *pump = malloc(sizeof(pump_t));
+        pthread_t thread;
+        if (pump) {
+            *pump = pumps->items[i];
+            pump->detached = background;
+        }
+        if (!pump || pthread_create(&thread, NULL, pump_thread, pump) != 0) {
+            fprintf(stderr, "cannot start pump thread\n");
+            if (pump) free(pump);
+            close_pump(&pumps->items[i]);
+            continue;
+        }
+        job_add_thread(job, thread);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    free(pumps->items);
+    pumps->items = NULL;
+    pumps->count = pumps->cap = 0;
+}
+
+// The dup2s the spawn engine will perform in the child
+static void trace_dup2s(const spawn_req_t *req) {
+    const char *name = req->argv[0];
+    if (req->stdin_fd != -1) trace_record(TRACE_DUP2, req->stdin_fd, STDIN_FILENO, name);
+    if (req->stdout_fd != -1) trace_record(TRACE_DUP2, req->stdout_fd, STDOUT_FILENO, name);
+    if (req->stderr_fd != -1)
+        trace_record(TRACE_DUP2, req->stderr_fd, STDERR_FILENO, name);
+    else if (req->stderr_to_stdout)
+        trace_record(TRACE_DUP2, STDOUT_FILENO, STDERR_FILENO, name);
+}
 
-        // Close pipe write end (unused)
-        if (has_pipe) {
-            close(pipefd[1]);
+// Start stage i of job. in_fd/out_fd are the pipe ends around it (-1 at
+// the ends of the pipeline); file redirections take precedence over them.
+static void launch_stage(job_t *job, size_t i, command_t *cmd, int in_fd, int out_fd,
+                         int foreground, pump_list_t *pumps) {
+    redir_fds_t files;
+    if (open_redirections(cmd, &files) == -1) {
+        if (datapump_interrupted()) job->procs[i].status = 128 + SIGINT;
+        return;
+    }
+
+    job->procs[i].status = 0;
+    int fan_write = -1;
+    int out = files.out != -1 ? files.out : out_fd;
+    if (files.more_count > 0 && (out = claim_fanout(pumps, job, &files, &fan_write)) == -1) {
+        close_redirections(&files);
+        job->procs[i].status = 1;
+        return;
+    }
+
+    // `2>&1 > file`: stderr keeps the stdout that the > replaced
+    if (cmd->stderr_before_out && out != out_fd &&
+        (files.err = fcntl(out_fd != -1 ? out_fd : STDOUT_FILENO, F_DUPFD_CLOEXEC, 3)) == -1) {
+        perror("fcntl");
+        close_redirections(&files);
+        if (fan_write != -1) close(fan_write);
+        job->procs[i].status = 1;
+        return;
+    }
+
+    pump_kind_t kind;
+    if (is_pump_command(cmd, &kind) &&
+        claim_stage(pumps, kind, job, i, cmd, &files, in_fd, out != -1 ? out : STDOUT_FILENO,
+                    foreground) == 0) {
+        cmd = NULL;
+    }
+
+    if (cmd && cmd->argv[0]) {
+        spawn_req_t req = {
+            .argv = cmd->argv,
+            .stdin_fd = files.in != -1 ? files.in : in_fd,
+            .stdout_fd = out,
+            .stderr_fd = files.err != -1 ? files.err : (cmd->pipe_stderr ? out : -1),
+            .stderr_to_stdout = cmd->stderr_to_stdout,
+            .setpgroup = jobs_control_enabled(),
+            .pgid = job->pgid,
+            .take_terminal = jobs_control_enabled() && foreground && job->pgid == 0,
+        };
+
+        if (trace_active) trace_dup2s(&req);
+
+        pid_t pid;
+        struct timespec spawn_start;
+        int timed = metrics_enabled();
+        if (timed) clock_gettime(CLOCK_MONOTONIC, &spawn_start);
+        int err = spawn_command(cmd, &req, &pid);
+        // posix_spawn returns once the child has exec'd
+        if (timed && err == 0) metrics_record(METRIC_SPAWN, cmd->argv[0], metrics_elapsed(&spawn_start));
+        TRACE(TRACE_SPAWN, err == 0 ? pid : -1, err, cmd->argv[0]);
+        if (err == 0) {
+            job_set_pid(job, i, pid);
+        } else {
+            fprintf(stderr, "exec failed: %s: %s\n", cmd->argv[0], strerror(err));
+            job->procs[i].status = (err == ENOENT) ? 127 : 126;
         }
+    }
+    // The fan-out pump sees EOF once the stage's copy is closed too
+    if (fan_write != -1) close(fan_write);
+    close_redirections(&files);
+}
 
-        // Close inherited input_fd if valid
-        if (input_fd != -1) close(input_fd);
+static void close_pipes(int (*pipes)[2], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (pipes[i][0] != -1) close(pipes[i][0]);
+        if (pipes[i][1] != -1) close(pipes[i][1]);
+    }
+}
 
-        // If has next pipe, recurse with pipe read end as new input
-        pid_t next_pid = -1;
-        if (has_pipe) {
-            next_pid = exec_pipeline(cmd->pipe_to, pipefd[0]);
-            if (next_pid == -1) {
-                // Error in recursion, close remaining fds
-                close(pipefd[0]);
+// Launch every stage of the pipeline without waiting. All pipes are created
+// first, so a failure leaves nothing running; the parent's copy of each end
+// is closed as soon as the stages on both sides have it.
+// pumps receives the work left to in-shell pumps.
+// Returns 0, or -1 if the pipes could not be created
+static int exec_pipeline(job_t *job, command_t *cmd, int foreground, pump_list_t *pumps) {
+    size_t npipes = job->nprocs - 1;
+    int (*pipes)[2] = NULL;
+
+    if (npipes > 0) {
+        pipes = malloc(npipes * sizeof(*pipes));
+        if (!pipes) {
+            perror("malloc");
+            return -1;
+        }
+        for (size_t i = 0; i < npipes; i++) {
+            if (pipe2(pipes[i], O_CLOEXEC) == -1) {
+                perror("pipe");
+                close_pipes(pipes, i);
+                free(pipes);
                 return -1;
             }
+            TRACE(TRACE_PIPE, pipes[i][0], pipes[i][1], NULL);
         }
+    }
 
-        // Wait for current child before returning if no next pipe
-        int status;
-        waitpid(pid, &status, 0);
+    size_t i = 0;
+    for (command_t *c = cmd; c; c = c->pipe_to, i++) {
+        int in_fd = i > 0 ? pipes[i - 1][0] : -1;
+        int out_fd = i < npipes ? pipes[i][1] : -1;
+        launch_stage(job, i, c, in_fd, out_fd, foreground, pumps);
 
-        // If pipeline, wait for last child and return that pid
-        if (has_pipe) {
-            waitpid(next_pid, &status, 0);
-            return next_pid;
+        if (in_fd != -1) {
+            close(in_fd);
+            pipes[i - 1][0] = -1;
+        }
+        if (out_fd != -1) {
+            close(out_fd);
+            pipes[i][1] = -1;
         }
-        return pid;
     }
+
+    free(pipes);
+    return 0;
 }
 
-int executor_execute(command_t *cmd) {
-    if (!cmd) return -1;
+// Pipeline text for job listings, stages joined by their pipe operators
+static char *pipeline_text(command_t *cmd) {
+    size_t len = 1;
+    for (command_t *c = cmd; c; c = c->pipe_to)
+        len += strlen(c->raw ? c->raw : "") + 4;
+
+    char *text = malloc(len);
+    if (!text) return NULL;
+    size_t used = 0;
+    for (command_t *c = cmd; c; c = c->pipe_to) {
+        used += (size_t)snprintf(text + used, len - used, "%s%s", c->raw ? c->raw : "",
+                                 c->pipe_to ? (c->pipe_stderr ? " |& " : " | ") : "");
+    }
+    return text;
+}
+
+int executor_execute(command_t *cmd, int background) {
+    if (!cmd || !cmd->argv) return -1;
+
+    struct timespec started;
+    int timed = !background && metrics_enabled();
+    if (timed) clock_gettime(CLOCK_MONOTONIC, &started);
+
+    size_t stages = 0;
+    for (command_t *c = cmd; c; c = c->pipe_to) stages++;
+
+    char *text = pipeline_text(cmd);
+    job_t *job = job_create(text, stages);
+    free(text);
+    if (!job) return -1;
+
+    // The shell still holds the terminal while it opens the redirections,
+    // and Ctrl-C must break an open() of a fifo nobody else opens. It then
+    // also reaches the shell when the job is only pumps
+    datapump_begin();
+    pump_list_t pumps = { NULL, 0, 0 };
+    if (exec_pipeline(job, cmd, !background, &pumps) == -1) {
+        datapump_end();
+        job_discard(job);
+        return -1;
+    }
+
+    if (background) {
+        datapump_end();
+        start_pumps(job, &pumps, 1);
+        job_run_background(job, 0);
+        return 0;
+    }
+
+    int pumping = pumps.count > 0;
+    if (!pumping) datapump_end();
+    start_pumps(job, &pumps, 0);
+    int status = job_wait_foreground(job, 0);
+    if (pumping) datapump_end();
+    if (timed) {
+        metrics_record(METRIC_WALL, cmd->argv[0], metrics_elapsed(&started));
+        metrics_record_status(cmd->argv[0], status);
+    }
+    return status;
+}
 
-    pid_t last_pid = exec_pipeline(cmd, -1);
-    if (last_pid == -1) return -1;
+// Walking a line's tree. A lone builtin runs in the shell itself; every
+// pipeline is started exactly once.
+typedef struct list_state {
+    int exit_requested;           // `exit` ran: skip the rest of the line
+    int interrupted;              // A foreground job died of Ctrl-C
+} list_state_t;
 
+// A builtin's status; `exit` itself succeeds and ends the line
+static int run_builtin(command_t *cmd, list_state_t *st) {
+    int status = builtin_execute(cmd);
+    if (status != SHELL_EXIT) return status;
+    st->exit_requested = 1;
     return 0;
 }
+
+// `time pipeline`: run the rest of the pipeline and report on it.
+// In the background the pipeline runs untimed, as the report would have
+// nowhere to go.
+static int run_timed(const pipeline_t *p, list_state_t *st) {
+    timecmd_t t;
+    command_t stripped;
+    if (timecmd_begin(&t, p->commands[0], &stripped) == -1) return 2;
+    if (stripped.argc == 0 && stripped.pipe_to) {
+        fprintf(stderr, "time: missing command before '|'\n");
+        return 2;
+    }
+
+    int status = 0;
+    int ran_job = 0;
+    if (stripped.argc == 0) {
+        // Bare `time`: just the (empty) report
+    } else if (!stripped.pipe_to && is_builtin(stripped.argv[0]) && !p->background) {
+        status = run_builtin(&stripped, st);
+    } else {
+        int ret = executor_execute(&stripped, p->background);
+        if (ret < 0) {
+            fprintf(stderr, "command execution failed\n");
+            return 1;
+        }
+        if (p->background) return 0;
+        ran_job = 1;
+        status = ret;
+        if (ret == 128 + SIGINT) st->interrupted = 1;
+    }
+    timecmd_end(&t, &stripped, ran_job, status);
+    return status;
+}
+
+static int run_pipeline(const pipeline_t *p, list_state_t *st) {
+    // A pipeline made only of empty aliases
+    if (p->count == 0) return 0;
+
+    command_t *cmd = p->commands[0];
+    if (timecmd_is_time(cmd)) return run_timed(p, st);
+    if (p->count == 1 && is_builtin(cmd->argv[0])) return run_builtin(cmd, st);
+
+    int ret = executor_execute(cmd, p->background);
+    if (ret < 0) {
+        fprintf(stderr, "command execution failed\n");
+        return 1;
+    }
+    // As in sh, Ctrl-C abandons the rest of the line, not just the job
+    if (!p->background && ret == 128 + SIGINT) st->interrupted = 1;
+    return ret;
+}
+
+static int run_node(const node_t *node, list_state_t *st) {
+    if (node->kind == NODE_PIPELINE) return run_pipeline(node->pipeline, st);
+
+    int status = run_node(node->left, st);
+    if (st->exit_requested || st->interrupted) return status;
+    if (node->kind == NODE_AND && status != 0) return status;
+    if (node->kind == NODE_OR && status == 0) return status;
+    return run_node(node->right, st);
+}
+
+int executor_run_list(command_list_t *cmdlist, int *exit_requested) {
+    list_state_t st = { 0, 0 };
+    int status = (cmdlist && cmdlist->root) ? run_node(cmdlist->root, &st) : 0;
+    if (exit_requested) *exit_requested = st.exit_requested;
+    return status;
+}
@@ -0,0 +1,248 @@
+// src/gitstatus.c
+#define _GNU_SOURCE
+#include "gitstatus.h"
+#include "spawner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define BRANCH_MAX 128
+
+// Shared with the worker, under lock. Requests and answers are numbered;
+// the worker always takes the newest request.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;                // Worker: new request or stop
+static pthread_cond_t answered;            // Shell: worker finished one
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_t worker;
+static int worker_started = 0;
+static int stopping = 0;
+
+static char want_dir[PATH_MAX];
+static unsigned long want_seq = 0;
+static unsigned long done_seq = 0;
+static unsigned long late_seq = 0;         // Request the shell stopped waiting for
+static char result_dir[PATH_MAX];
+static char result[BRANCH_MAX + 2];
+
+static int notify_pipe[2] = { -1, -1 };
+
+static void init(void) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&answered, &attr);
+    pthread_cond_init(&wake, NULL);
+    pthread_condattr_destroy(&attr);
+    if (pipe2(notify_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+        notify_pipe[0] = notify_pipe[1] = -1;
+}
+
+// Read the first line of path into buf; returns its length or -1
+static ssize_t read_line(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    char *nl = strchr(buf, '\n');
+    if (nl) *nl = '\0';
+    return (ssize_t)strlen(buf);
+}
+
+// Find the repository around dir: its work tree and git directory.
+// Returns 0, or -1 when there is none or a path does not fit PATH_MAX
+static int find_repo(const char *dir, char *worktree, char *gitdir) {
+    char path[PATH_MAX];
+    if (snprintf(worktree, PATH_MAX, "%s", dir) >= PATH_MAX) return -1;
+
+    for (;;) {
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s/.git", strcmp(worktree, "/") ? worktree : "") >= (int)sizeof(path))
+            return -1;
+        if (stat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                snprintf(gitdir, PATH_MAX, "%s", path);
+                return 0;
+            }
+            // Linked worktrees and submodules: "gitdir: <path>"
+            char line[PATH_MAX];
+            if (read_line(path, line, sizeof(line)) > 8 && strncmp(line, "gitdir: ", 8) == 0) {
+                int n;
+                if (line[8] == '/')
+                    n = snprintf(gitdir, PATH_MAX, "%s", line + 8);
+                else
+                    n = snprintf(gitdir, PATH_MAX, "%s/%s", worktree, line + 8);
+                return n < PATH_MAX ? 0 : -1;
+            }
+        }
+
+        char *slash = strrchr(worktree, '/');
+        if (!slash || strcmp(worktree, "/") == 0) return -1;
+        if (slash == worktree)
+            slash[1] = '\0';
+        else
+            *slash = '\0';
+    }
+}
+
+// 1 if `git status` lists changes to tracked files. Only the first byte of
+// its output is needed. --no-optional-locks keeps the index untouched.
+static int is_dirty(const char *worktree) {
+    char *argv[] = {
+        "git", "--no-optional-locks", "-C", (char *)worktree, "status", "--porcelain",
+        "--untracked-files=no", NULL
+    };
+    int out[2];
+    if (pipe2(out, O_CLOEXEC) == -1) return 0;
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+
+    // Its own process group keeps Ctrl-C at the prompt away from it
+    spawn_req_t req = {
+        .argv = argv,
+        .stdin_fd = null_fd,
+        .stdout_fd = out[1],
+        .stderr_fd = null_fd,
+        .setpgroup = 1,
+    };
+    pid_t pid;
+    int err = spawn_process(&req, &pid);
+    close(out[1]);
+    if (null_fd != -1) close(null_fd);
+
+    char c;
+    ssize_t n = 0;
+    if (err == 0) {
+        while ((n = read(out[0], &c, 1)) == -1 && errno == EINTR) continue;
+    }
+    close(out[0]);
+    if (err == 0) {
+        while (waitpid(pid, NULL, 0) == -1 && errno == EINTR) continue;
+    }
+    return n > 0;
+}
+
+static void lookup(const char *dir, char *buf, size_t size) {
+    char worktree[PATH_MAX], gitdir[PATH_MAX], path[PATH_MAX], head[PATH_MAX];
+    buf[0] = '\0';
+    if (find_repo(dir, worktree, gitdir) == -1) return;
+
+    if (snprintf(path, sizeof(path), "%s/HEAD", gitdir) >= (int)sizeof(path)) return;
+    if (read_line(path, head, sizeof(head)) <= 0) return;
+
+    // A branch, or the abbreviated commit of a detached HEAD
+    const char *branch = head;
+    if (strncmp(head, "ref: refs/heads/", 16) == 0)
+        branch = head + 16;
+    else if (strncmp(head, "ref: ", 5) == 0)
+        branch = head + 5;
+    else
+        head[7] = '\0';
+
+    snprintf(buf, size, "%.*s%s", BRANCH_MAX, branch, is_dirty(worktree) ? "*" : "");
+}
+
+static void *worker_main(void *arg) {
+    (void)arg;
+    char dir[PATH_MAX];
+    char answer[sizeof(result)];
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (!stopping && done_seq == want_seq) pthread_cond_wait(&wake, &lock);
+        if (stopping) break;
+        unsigned long seq = want_seq;
+        snprintf(dir, sizeof(dir), "%s", want_dir);
+        pthread_mutex_unlock(&lock);
+
+        lookup(dir, answer, sizeof(answer));
+
+        pthread_mutex_lock(&lock);
+        snprintf(result, sizeof(result), "%s", answer);
+        snprintf(result_dir, sizeof(result_dir), "%s", dir);
+        done_seq = seq;
+        int late = (late_seq == seq);
+        pthread_cond_broadcast(&answered);
+        if (late && notify_pipe[1] != -1) {
+            char byte = 1;
+            ssize_t w = write(notify_pipe[1], &byte, 1);
+            (void)w;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+void gitstatus_request(const char *dir) {
+    pthread_once(&init_once, init);
+
+    pthread_mutex_lock(&lock);
+    if (!worker_started) {
+        // Signals stay with the shell's main thread
+        sigset_t all, saved;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &saved);
+        worker_started = pthread_create(&worker, NULL, worker_main, NULL) == 0;
+        pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    }
+    snprintf(want_dir, sizeof(want_dir), "%s", dir);
+    want_seq++;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+int gitstatus_get(char *buf, size_t size, int budget_ms) {
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    if (!worker_started) return 0;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += budget_ms / 1000;
+    deadline.tv_nsec += (long)(budget_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&lock);
+    while (done_seq != want_seq) {
+        if (pthread_cond_timedwait(&answered, &lock, &deadline) == ETIMEDOUT) break;
+    }
+    int current = (done_seq == want_seq);
+    if (!current) late_seq = want_seq;
+    if (strcmp(result_dir, want_dir) == 0) snprintf(buf, size, "%s", result);
+    pthread_mutex_unlock(&lock);
+    return current;
+}
+
+int gitstatus_event_fd(void) {
+    return notify_pipe[0];
+}
+
+void gitstatus_event_clear(void) {
+    char buf[64];
+    if (notify_pipe[0] == -1) return;
+    while (read(notify_pipe[0], buf, sizeof(buf)) > 0) continue;
+}
+
+void gitstatus_free(void) {
+    if (!worker_started) return;
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    // Not joined: exit should not wait for a slow `git status`
+    pthread_detach(worker);
+    worker_started = 0;
+}
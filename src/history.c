@@ -4,61 +4,551 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define MAX_HISTORY 1000
+// History is a ring of `capacity` slots. Line text lives in one string
+// arena; slots record each line's logical byte position in the arena, so
+// appending, evicting the oldest line and indexed access are all O(1).
+// When the write position reaches the end of the arena, the live bytes
+// are moved to the front (and the arena doubled if still too small),
+// which is amortized O(1) per byte appended.
+
+typedef struct hist_slot {
+    size_t pos;                   // Logical arena position of the line
+    size_t len;                   // Line length, excluding the NUL
+} hist_slot_t;
+
+static hist_slot_t *slots = NULL;
+static size_t capacity = 0;
+static size_t head = 0;           // Slot of the oldest line
+static size_t history_count = 0;
+static size_t session_adds = 0;   // Lines pushed to the ring since startup
+
+static char *arena = NULL;
+static size_t arena_size = 0;
+static size_t arena_base = 0;     // Logical position of arena[0]
+static size_t arena_end = 0;      // Logical position of the next write
+
+// Persistence is append-only: every added line becomes one record appended
+// to the file under flock, so concurrent shells interleave instead of
+// overwriting each other and nothing is lost if the shell is killed.
+// Records are buffered for flush_every lines (1 = write each command).
+// The file is compacted to the newest `capacity` lines only once it grows
+// past twice the size those lines had when last loaded or compacted.
+
+#define HISTORY_COMPACT_MIN (64 * 1024)
 
-static char *history[MAX_HISTORY];
-static int history_count = 0;
 static char history_filename[512] = {0};
+static int history_fd = -1;
+static size_t flush_every = 1;
+static char *pending = NULL;      // Records not yet written
+static size_t pending_len = 0, pending_cap = 0, pending_lines = 0;
+static size_t kept_bytes = 0;     // Size of the newest lines at last load/compaction
 
-void history_init(const char *filename) {
-    if (!filename) return;
-    strncpy(history_filename, filename, sizeof(history_filename)-1);
-    FILE *fp = fopen(history_filename, "r");
-    if (!fp) return;
-
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
-    while ((read=getline(&line, &len, fp)) != -1) {
-        if (read>0 && (line[read-1] == '\n' || line[read-1] == '\r')) line[read-1] = 0;
-        if (history_count < MAX_HISTORY) {
-            history[history_count++] = strdup(line);
+// Lines already in the file at startup are not read into the ring. A
+// sidecar index (<file>.idx) holds the start offset of every line, so
+// startup costs the same for 1k or 1M lines; only lines appended since the
+// index was last written get scanned. The newest `capacity` lines, and
+// their offsets, are then copied out of a mapping of the file: other shells
+// (or the user) may truncate or rewrite it at any time, and touching a
+// mapping past the new end of file raises SIGBUS. A line is materialized
+// on first access by overwriting its newline with a NUL in the copy. Of the
+// loaded lines, only the newest (capacity - lines added this session) stay
+// visible.
+
+#define HISTORY_INDEX_MAGIC "KSHIDX2"
+#define HISTORY_INDEX_SAMPLE 4096 // Bytes hashed at each end of the covered prefix
+
+typedef struct hist_index_header {
+    char magic[8];
+    uint64_t dev, ino;            // History file the index describes
+    uint64_t covered;             // Bytes of complete lines indexed
+    uint64_t check;               // prefix_check() of those bytes
+    uint64_t count;               // Number of offsets that follow
+} hist_index_header_t;
+
+static char *file_map = NULL;     // Mapping of the history file, while loading
+static size_t file_map_len = 0;
+static size_t file_covered = 0;   // Bytes of complete lines in file_map
+static char *file_text = NULL;    // Copy of the loaded lines
+static size_t file_text_len = 0;
+static uint64_t *file_offsets = NULL;  // Line starts in file_text
+static size_t file_lines = 0;     // Lines in file_text
+static size_t file_skipped = 0;   // Older lines of the file, not loaded
+
+static inline char *slot_text(const hist_slot_t *s) {
+    return arena + (s->pos - arena_base);
+}
+
+// Make room for need more bytes at arena_end
+static int arena_reserve(size_t need) {
+    if (arena_end - arena_base + need <= arena_size)
+        return 0;
+
+    size_t live_start = history_count ? slots[head].pos : arena_end;
+    size_t live = arena_end - live_start;
+
+    if ((live + need) * 2 > arena_size) {
+        size_t new_size = arena_size ? arena_size : 4096;
+        while ((live + need) * 2 > new_size) new_size *= 2;
+        char *tmp = malloc(new_size);
+        if (!tmp) return -1;
+        if (live) memcpy(tmp, arena + (live_start - arena_base), live);
+        free(arena);
+        arena = tmp;
+        arena_size = new_size;
+    } else if (live) {
+        memmove(arena, arena + (live_start - arena_base), live);
+    }
+    arena_base = live_start;
+    return 0;
+}
+
+static void history_set_capacity(size_t cap) {
+    if (cap == 0) cap = HISTORY_DEFAULT_SIZE;
+    hist_slot_t *tmp = calloc(cap, sizeof(hist_slot_t));
+    if (!tmp) return;
+    free(slots);
+    slots = tmp;
+    capacity = cap;
+    head = 0;
+    history_count = 0;
+    session_adds = 0;
+    arena_base = arena_end = 0;
+}
+
+// (Re)open the history file for appending
+static int open_history_file(void) {
+    if (history_fd != -1) close(history_fd);
+    history_fd = open(history_filename, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    return history_fd;
+}
+
+// Lock the history file, following it if another shell replaced it
+// through compaction while we were waiting for the lock
+static int lock_history_file(void) {
+    for (int tries = 0; tries < 8; tries++) {
+        if (history_fd == -1 && open_history_file() == -1) return -1;
+        if (flock(history_fd, LOCK_EX) == -1) return -1;
+
+        struct stat fd_st, path_st;
+        if (fstat(history_fd, &fd_st) == 0 && stat(history_filename, &path_st) == 0 &&
+            fd_st.st_dev == path_st.st_dev && fd_st.st_ino == path_st.st_ino)
+            return 0;
+
+        flock(history_fd, LOCK_UN);
+        close(history_fd);
+        history_fd = -1;
+    }
+    return -1;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
         }
+        buf += n;
+        len -= (size_t)n;
     }
-    free(line);
-    fclose(fp);
+    return 0;
 }
 
-void history_add(const char *line) {
-    if (!line || line[0]=='\0') return;
-    // ignore duplicates of last command
-    if (history_count > 0 && strcmp(history[history_count-1], line) == 0)
+// Append the start offsets of the lines in data[from, to) to *offs
+static int scan_offsets(const char *data, size_t from, size_t to,
+                        uint64_t **offs, size_t *count, size_t *cap) {
+    size_t pos = from;
+    while (pos < to) {
+        if (*count == *cap) {
+            size_t new_cap = *cap ? *cap * 2 : 1024;
+            uint64_t *tmp = realloc(*offs, new_cap * sizeof(uint64_t));
+            if (!tmp) return -1;
+            *offs = tmp;
+            *cap = new_cap;
+        }
+        (*offs)[(*count)++] = pos;
+        const char *nl = memchr(data + pos, '\n', to - pos);
+        if (!nl) break;
+        pos = (size_t)(nl - data) + 1;
+    }
+    return 0;
+}
+
+// FNV-1a over the first and last HISTORY_INDEX_SAMPLE bytes of data[0, len).
+// A file truncated or rewritten in place keeps its inode, and may again
+// have a newline where the index ends; its contents there will differ.
+// Hashing the ends only keeps startup independent of the file size.
+static uint64_t prefix_check(const char *data, size_t len) {
+    uint64_t h = 14695981039346656037ULL ^ len;
+    size_t head = len < HISTORY_INDEX_SAMPLE ? len : HISTORY_INDEX_SAMPLE;
+    size_t tail = len - head < HISTORY_INDEX_SAMPLE ? len - head : HISTORY_INDEX_SAMPLE;
+    for (size_t i = 0; i < head; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    for (size_t i = len - tail; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void index_path(char *buf, size_t bufsize, const char *filename) {
+    snprintf(buf, bufsize, "%s.idx", filename);
+}
+
+// Write a complete index for data[0, len) of the file identified by st.
+// Called with the history file locked. The index is written to a temporary
+// file renamed over the old one: other shells may be reading it.
+static int write_index(const char *path, const struct stat *st, const char *data, size_t len) {
+    uint64_t *offs = NULL;
+    size_t count = 0, cap = 0;
+    if (scan_offsets(data, 0, len, &offs, &count, &cap) != 0) {
+        free(offs);
+        return -1;
+    }
+
+    hist_index_header_t hdr = {0};
+    memcpy(hdr.magic, HISTORY_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.dev = st->st_dev;
+    hdr.ino = st->st_ino;
+    hdr.covered = len;
+    hdr.check = prefix_check(data, len);
+    hdr.count = count;
+
+    char tmp_name[sizeof(history_filename) + 40];
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp.%ld", path, (long)getpid());
+    int rc = -1;
+    int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd != -1) {
+        if (write_all(fd, (const char *)&hdr, sizeof(hdr)) == 0 &&
+            write_all(fd, (const char *)offs, count * sizeof(uint64_t)) == 0)
+            rc = 0;
+        if (close(fd) != 0) rc = -1;
+        if (rc == 0 && rename(tmp_name, path) != 0) rc = -1;
+        if (rc != 0) unlink(tmp_name);
+    }
+    free(offs);
+    return rc;
+}
+
+// Rewrite the (locked) history file keeping only its newest lines
+static void compact_history_file(off_t size) {
+    int rfd = open(history_filename, O_RDONLY | O_CLOEXEC);
+    if (rfd == -1) return;
+    char *data = malloc((size_t)size);
+    ssize_t got = 0;
+    while (data && got < size) {
+        ssize_t n = read(rfd, data + got, (size_t)(size - got));
+        if (n <= 0) break;
+        got += n;
+    }
+    close(rfd);
+    if (!data || got != size) {
+        free(data);
         return;
+    }
+
+    // Walk back over `capacity` complete lines
+    size_t start = (size_t)size, lines = 0;
+    if (start > 0 && data[start - 1] == '\n') start--;
+    while (start > 0 && lines < capacity) {
+        start--;
+        if (data[start] == '\n') lines++;
+    }
+    if (lines == capacity) start++;
+
+    char tmp_name[sizeof(history_filename) + 32];
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp.%ld", history_filename, (long)getpid());
+    int wfd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (wfd != -1) {
+        struct stat st;
+        if (write_all(wfd, data + start, (size_t)size - start) == 0 && fstat(wfd, &st) == 0 &&
+            close(wfd) == 0) {
+            // Index the compacted file too so the next startup needn't scan it
+            char idx_name[sizeof(history_filename) + 8];
+            index_path(idx_name, sizeof(idx_name), history_filename);
+            write_index(idx_name, &st, data + start, (size_t)size - start);
 
-    if (history_count == MAX_HISTORY) {
-        free(history[0]);
-        for (int i=1; i < MAX_HISTORY; i++) {
-            history[i-1] = history[i];
+            // Shells blocked on the old file notice the new inode once locked
+            if (rename(tmp_name, history_filename) == 0) {
+                kept_bytes = (size_t)size - start;
+                int old_fd = history_fd;
+                history_fd = -1;
+                open_history_file();
+                close(old_fd);
+            } else {
+                unlink(tmp_name);
+            }
+        } else {
+            close(wfd);
+            unlink(tmp_name);
         }
+    }
+    free(data);
+}
+
+// Append buffered records to the file
+static void flush_pending(void) {
+    if (pending_len == 0 || history_filename[0] == 0) return;
+    if (lock_history_file() != 0) return;
+
+    // Terminate a partial line left behind by an interrupted writer
+    struct stat st;
+    char last;
+    if (fstat(history_fd, &st) == 0 && st.st_size > 0 &&
+        pread(history_fd, &last, 1, st.st_size - 1) == 1 && last != '\n')
+        write_all(history_fd, "\n", 1);
+
+    if (write_all(history_fd, pending, pending_len) == 0) {
+        pending_len = 0;
+        pending_lines = 0;
+    }
+
+    size_t held = kept_bytes + (history_count ? arena_end - slots[head].pos : 0);
+    off_t threshold = (off_t)(held * 2 > HISTORY_COMPACT_MIN ? held * 2 : HISTORY_COMPACT_MIN);
+    if (fstat(history_fd, &st) == 0 && st.st_size > threshold)
+        compact_history_file(st.st_size);
+
+    if (history_fd != -1) flock(history_fd, LOCK_UN);
+}
+
+static void queue_record(const char *line, size_t len) {
+    if (history_filename[0] == 0) return;
+    if (pending_len + len + 1 > pending_cap) {
+        size_t cap = pending_cap ? pending_cap : 1024;
+        while (cap < pending_len + len + 1) cap *= 2;
+        char *tmp = realloc(pending, cap);
+        if (!tmp) return;
+        pending = tmp;
+        pending_cap = cap;
+    }
+    memcpy(pending + pending_len, line, len);
+    pending[pending_len + len] = '\n';
+    pending_len += len + 1;
+
+    if (++pending_lines >= flush_every)
+        flush_pending();
+}
+
+// Number of mapped file lines still visible
+static inline size_t file_visible(void) {
+    size_t room = capacity - history_count;
+    return file_lines < room ? file_lines : room;
+}
+
+// NUL-terminate loaded line i in place and return it
+static const char *file_line(size_t i) {
+    size_t start = (size_t)file_offsets[i];
+    size_t end = (i + 1 < file_lines ? (size_t)file_offsets[i + 1] : file_text_len) - 1;
+    if (file_text[end] != '\0') {
+        file_text[end] = '\0';
+        if (end > start && file_text[end - 1] == '\r') file_text[end - 1] = '\0';
+    }
+    return file_text + start;
+}
+
+// Add line to the in-memory ring; returns 1 if it was stored
+static int history_push(const char *line) {
+    if (!line || line[0]=='\0' || capacity == 0) return 0;
+    size_t len = strlen(line);
+
+    // ignore duplicates of last command
+    if (history_count > 0) {
+        const hist_slot_t *last = &slots[(head + history_count - 1) % capacity];
+        if (last->len == len && memcmp(slot_text(last), line, len) == 0)
+            return 0;
+    } else if (file_visible() > 0 && strcmp(file_line(file_lines - 1), line) == 0) {
+        return 0;
+    }
+
+    // Evict the oldest line before reserving so its bytes can be reclaimed
+    if (history_count == capacity) {
+        head = (head + 1) % capacity;
         history_count--;
     }
-    history[history_count++] = strdup(line);
+    if (arena_reserve(len + 1) != 0) return 0;
+
+    hist_slot_t *s = &slots[(head + history_count) % capacity];
+    s->pos = arena_end;
+    s->len = len;
+    memcpy(slot_text(s), line, len + 1);
+    arena_end += len + 1;
+    history_count++;
+    session_adds++;
+    return 1;
 }
 
-void history_save(void) {
-    if (history_count == 0 || history_filename[0] == 0) return;
-    FILE *fp = fopen(history_filename, "w");
-    if (!fp) return;
-    for (int i=0; i < history_count; i++) {
-        fprintf(fp, "%s\n", history[i]);
+void history_add(const char *line) {
+    if (history_push(line))
+        queue_record(line, strlen(line));
+}
+
+// Bring the sidecar index up to date with file_map and copy the offsets
+// of its newest `capacity` lines. Called with the history file locked.
+static int load_index(const struct stat *st) {
+    char path[sizeof(history_filename) + 8];
+    index_path(path, sizeof(path), history_filename);
+
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    hist_index_header_t hdr;
+    int valid = fd != -1 && pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+                memcmp(hdr.magic, HISTORY_INDEX_MAGIC, sizeof(hdr.magic)) == 0 &&
+                hdr.dev == (uint64_t)st->st_dev && hdr.ino == (uint64_t)st->st_ino &&
+                hdr.covered <= file_covered &&
+                (hdr.covered == 0 || file_map[hdr.covered - 1] == '\n') &&
+                hdr.check == prefix_check(file_map, (size_t)hdr.covered);
+
+    if (valid && hdr.covered < file_covered) {
+        // Index only the lines appended since the index was written
+        uint64_t *offs = NULL;
+        size_t count = 0, cap = 0;
+        off_t at = (off_t)(sizeof(hdr) + hdr.count * sizeof(uint64_t));
+        valid = scan_offsets(file_map, (size_t)hdr.covered, file_covered, &offs, &count, &cap) == 0 &&
+                pwrite(fd, offs, count * sizeof(uint64_t), at) == (ssize_t)(count * sizeof(uint64_t));
+        free(offs);
+        if (valid) {
+            hdr.covered = file_covered;
+            hdr.check = prefix_check(file_map, file_covered);
+            hdr.count += count;
+            valid = pwrite(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr);
+        }
     }
-    fclose(fp);
+
+    if (!valid) {
+        if (fd != -1) close(fd);
+        if (write_index(path, st, file_map, file_covered) != 0) return -1;
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1 || pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+            if (fd != -1) close(fd);
+            return -1;
+        }
+    }
+
+    size_t first = hdr.count > capacity ? (size_t)hdr.count - capacity : 0;
+    size_t count = (size_t)hdr.count - first;
+    size_t bytes = count * sizeof(uint64_t);
+    file_offsets = malloc(bytes ? bytes : 1);
+    int ok = file_offsets &&
+             pread(fd, file_offsets, bytes, (off_t)(sizeof(hdr) + first * sizeof(uint64_t))) == (ssize_t)bytes;
+    close(fd);
+    if (!ok) return -1;
+    file_skipped = first;
+    file_lines = count;
+    return 0;
 }
 
-void history_free(void) {
-    for (int i=0; i < history_count; i++) {
-        free(history[i]);
+static void unmap_file(void) {
+    if (file_map) munmap(file_map, file_map_len);
+    file_map = NULL;
+    file_map_len = file_covered = 0;
+}
+
+static void drop_file_lines(void) {
+    free(file_text);
+    free(file_offsets);
+    file_text = NULL;
+    file_offsets = NULL;
+    file_text_len = file_lines = file_skipped = 0;
+}
+
+// Load the newest lines of the history file through its index
+static void map_history_file(void) {
+    int fd = open(history_filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return;
     }
-    history_count = 0;
+    file_map_len = (size_t)st.st_size;
+    file_map = mmap(NULL, file_map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file_map == MAP_FAILED) {
+        file_map = NULL;
+        file_map_len = 0;
+        return;
+    }
+
+    // A trailing partial line (interrupted write) is left out
+    const char *nl = memrchr(file_map, '\n', file_map_len);
+    file_covered = nl ? (size_t)(nl - file_map) + 1 : 0;
+
+    if (file_covered == 0 || load_index(&st) != 0 || file_lines == 0) {
+        unmap_file();
+        drop_file_lines();
+        return;
+    }
+
+    size_t start = (size_t)file_offsets[0];
+    file_text_len = file_covered - start;
+    file_text = malloc(file_text_len);
+    if (!file_text) {
+        unmap_file();
+        drop_file_lines();
+        return;
+    }
+    memcpy(file_text, file_map + start, file_text_len);
+    unmap_file();
+    for (size_t i = 0; i < file_lines; i++) file_offsets[i] -= start;
+    kept_bytes = file_text_len;
+}
+
+void history_init(const char *filename, size_t size, size_t flush_lines) {
+    history_set_capacity(size);
+    flush_every = flush_lines ? flush_lines : 1;
+    if (!filename) return;
+    strncpy(history_filename, filename, sizeof(history_filename)-1);
+
+    // The lock keeps a concurrent compaction or index update out
+    if (lock_history_file() != 0) return;
+    map_history_file();
+    flock(history_fd, LOCK_UN);
+}
+
+size_t history_len(void) {
+    return file_visible() + history_count;
+}
+
+size_t history_first(void) {
+    return file_skipped + file_lines + session_adds - history_len();
+}
+
+const char *history_at(size_t index) {
+    size_t from_file = file_visible();
+    if (index < from_file)
+        return file_line(file_lines - from_file + index);
+    index -= from_file;
+    if (index >= history_count) return NULL;
+    return slot_text(&slots[(head + index) % capacity]);
+}
+
+void history_save(void) {
+    flush_pending();
+}
+
+void history_free(void) {
+    if (history_fd != -1) close(history_fd);
+    history_fd = -1;
+    free(pending);
+    pending = NULL;
+    pending_len = pending_cap = pending_lines = 0;
+    unmap_file();
+    drop_file_lines();
+    kept_bytes = 0;
+    free(slots);
+    free(arena);
+    slots = NULL;
+    arena = NULL;
+    capacity = head = history_count = session_adds = 0;
+    arena_size = arena_base = arena_end = 0;
 }
@@ -0,0 +1,330 @@
+// src/histsearch.c
+#define _GNU_SOURCE
+#include "histsearch.h"
+#include "history.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <readline/readline.h>
+
+// Trigram index: every lowercased 3-byte window of a line maps to the
+// ascending list of history numbers containing it. A query only verifies
+// the lines in the shortest posting list among its trigrams. The index is
+// built on the first search and extended with newer lines on later ones;
+// numbers of evicted lines are skipped, and dropped at the next rebuild.
+
+#define RSEARCH_MAX 256
+#define RANK_WINDOW 4
+
+typedef struct posting {
+    uint32_t key;                 // Packed trigram + 1, 0 marks an empty slot
+    uint32_t count, cap;
+    uint32_t *ids;                // History numbers, ascending
+} posting_t;
+
+static posting_t *table = NULL;
+static size_t table_cap = 0;
+static size_t table_used = 0;
+static size_t indexed_from = 0;   // History numbers covered: [from, to)
+static size_t indexed_to = 0;
+
+static inline uint32_t trigram(const char *p) {
+    return ((uint32_t)tolower((unsigned char)p[0]) << 16 |
+            (uint32_t)tolower((unsigned char)p[1]) << 8 |
+            (uint32_t)tolower((unsigned char)p[2])) + 1;
+}
+
+static inline size_t hash_key(uint32_t key) {
+    uint32_t h = key * 2654435761u;
+    return h ^ (h >> 15);
+}
+
+static posting_t *lookup(uint32_t key) {
+    if (table_cap == 0) return NULL;
+    size_t mask = table_cap - 1;
+    for (size_t i = hash_key(key) & mask;; i = (i + 1) & mask) {
+        if (table[i].key == key) return &table[i];
+        if (table[i].key == 0) return NULL;
+    }
+}
+
+static int grow_table(void) {
+    size_t new_cap = table_cap ? table_cap * 2 : 1024;
+    posting_t *new_table = calloc(new_cap, sizeof(posting_t));
+    if (!new_table) return -1;
+    for (size_t i = 0; i < table_cap; i++) {
+        if (!table[i].key) continue;
+        size_t j = hash_key(table[i].key) & (new_cap - 1);
+        while (new_table[j].key) j = (j + 1) & (new_cap - 1);
+        new_table[j] = table[i];
+    }
+    free(table);
+    table = new_table;
+    table_cap = new_cap;
+    return 0;
+}
+
+static posting_t *lookup_or_insert(uint32_t key) {
+    posting_t *p = lookup(key);
+    if (p) return p;
+    if ((table_used + 1) * 4 > table_cap * 3 && grow_table() != 0)
+        return NULL;
+    size_t mask = table_cap - 1;
+    size_t i = hash_key(key) & mask;
+    while (table[i].key) i = (i + 1) & mask;
+    table[i].key = key;
+    table_used++;
+    return &table[i];
+}
+
+static void add_line(size_t number, const char *line) {
+    size_t len = strlen(line);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        posting_t *p = lookup_or_insert(trigram(line + i));
+        if (!p) return;
+        // A trigram repeated within the line is posted once
+        if (p->count && p->ids[p->count - 1] == (uint32_t)number) continue;
+        if (p->count == p->cap) {
+            uint32_t cap = p->cap ? p->cap * 2 : 4;
+            uint32_t *tmp = realloc(p->ids, cap * sizeof(uint32_t));
+            if (!tmp) return;
+            p->ids = tmp;
+            p->cap = cap;
+        }
+        p->ids[p->count++] = (uint32_t)number;
+    }
+}
+
+void histsearch_free(void) {
+    for (size_t i = 0; i < table_cap; i++) free(table[i].ids);
+    free(table);
+    table = NULL;
+    table_cap = table_used = 0;
+    indexed_from = indexed_to = 0;
+}
+
+// Index lines added since the last search
+static void index_update(void) {
+    size_t first = history_first();
+    size_t end = first + history_len();
+
+    // Rebuild once evicted lines outnumber live ones (or history restarted)
+    if (indexed_to > end || (first > indexed_from && first - indexed_from > end - first))
+        histsearch_free();
+    if (table_cap == 0)
+        indexed_from = indexed_to = first;
+    if (indexed_to < first)
+        indexed_to = first;
+
+    for (size_t n = indexed_to; n < end; n++)
+        add_line(n, history_at(n - first));
+    indexed_to = end;
+}
+
+// 0: line starts with pattern, 1: pattern starts a word, 2: elsewhere, -1: no match
+static int match_rank(const char *line, const char *pattern) {
+    const char *hit = strcasestr(line, pattern);
+    if (!hit) return -1;
+    if (hit == line) return 0;
+    for (; hit; hit = strcasestr(hit + 1, pattern)) {
+        char prev = hit[-1];
+        if (isspace((unsigned char)prev) || prev == '/' || prev == '|' || prev == '=')
+            return 1;
+    }
+    return 2;
+}
+
+size_t histsearch_find(const char *pattern, hist_match_t *out, size_t max) {
+    if (!pattern || !*pattern || !out || max == 0) return 0;
+
+    size_t plen = strlen(pattern);
+    size_t first = history_first();
+    size_t len = history_len();
+
+    // Candidates come from the shortest posting list; short patterns scan
+    const uint32_t *ids = NULL;
+    size_t nids = 0;
+    if (plen >= 3) {
+        index_update();
+        for (size_t i = 0; i + 3 <= plen; i++) {
+            posting_t *p = lookup(trigram(pattern + i));
+            if (!p) return 0;
+            if (!ids || p->count < nids) {
+                ids = p->ids;
+                nids = p->count;
+            }
+        }
+    }
+
+    hist_match_t *tiers[3];
+    size_t counts[3] = {0, 0, 0};
+    tiers[0] = out;
+    tiers[1] = malloc(2 * max * sizeof(hist_match_t));
+    if (!tiers[1]) return 0;
+    tiers[2] = tiers[1] + max;
+
+    // Walk newest to oldest; ranking is applied within the newest
+    // RANK_WINDOW * max distinct matches so a search stays bounded
+    size_t remaining = ids ? nids : len;
+    size_t matched = 0;
+    while (remaining-- > 0 && counts[0] < max && matched < RANK_WINDOW * max) {
+        size_t number = ids ? ids[remaining] : first + remaining;
+        if (number < first) break;
+
+        const char *line = history_at(number - first);
+        int rank = match_rank(line, pattern);
+        if (rank < 0) continue;
+        if (counts[rank] == max) {
+            matched++;
+            continue;
+        }
+
+        int seen = 0;
+        for (size_t i = 0; i < counts[rank] && !seen; i++)
+            seen = strcmp(tiers[rank][i].line, line) == 0;
+        if (seen) continue;
+
+        tiers[rank][counts[rank]].number = number;
+        tiers[rank][counts[rank]].line = line;
+        counts[rank]++;
+        matched++;
+    }
+
+    size_t total = counts[0];
+    for (int t = 1; t < 3; t++) {
+        for (size_t i = 0; i < counts[t] && total < max; i++)
+            out[total++] = tiers[t][i];
+    }
+    free(tiers[1]);
+    return total;
+}
+
+// Ctrl-R: incremental search over the ranked matches. Ctrl-R again steps
+// to the next match, Enter runs it, Ctrl-G restores the original line and
+// any other key keeps the match for editing.
+static int reverse_search(int count, int key) {
+    (void)count;
+    (void)key;
+
+    char query[256] = {0};
+    size_t qlen = 0, nth = 0;
+    hist_match_t *matches = malloc(RSEARCH_MAX * sizeof(hist_match_t));
+    char *original = strdup(rl_line_buffer);
+    if (!matches || !original) {
+        free(matches);
+        free(original);
+        return 0;
+    }
+
+    const char *current = original;
+    int next_key = 0, done = 0;
+    rl_save_prompt();
+
+    while (!done) {
+        size_t found = qlen ? histsearch_find(query, matches, RSEARCH_MAX) : 0;
+        if (found) {
+            if (nth >= found) nth = found - 1;
+            current = matches[nth].line;
+        }
+
+        rl_message("(%sreverse-i-search)`%s': ", qlen && !found ? "failed " : "", query);
+        rl_replace_line(current, 0);
+        const char *hit = qlen ? strcasestr(current, query) : NULL;
+        rl_point = hit ? (int)(hit - current) : rl_end;
+        rl_redisplay();
+
+        int c = rl_read_key();
+        if (c == CTRL('R')) {
+            if (nth + 1 < found) nth++;
+            else rl_ding();
+        } else if (c == CTRL('G')) {
+            current = original;
+            done = 1;
+        } else if (c == RUBOUT || c == CTRL('H')) {
+            if (qlen) query[--qlen] = '\0';
+            nth = 0;
+        } else if (c == '\r' || c == '\n') {
+            next_key = '\n';
+            done = 1;
+        } else if (isprint(c) && qlen + 1 < sizeof(query)) {
+            query[qlen++] = (char)c;
+            query[qlen] = '\0';
+            nth = 0;
+        } else {
+            next_key = c;
+            done = 1;
+        }
+    }
+
+    rl_restore_prompt();
+    rl_clear_message();
+    rl_replace_line(current, 0);
+    rl_point = rl_end;
+    free(original);
+    free(matches);
+
+    if (next_key) rl_execute_next(next_key);
+    rl_redisplay();
+    return 0;
+}
+
+// Up/Down walk history_at() directly; the line being edited is kept
+// aside while browsing and restored when stepping past the newest entry
+static size_t nav_pos = 0;
+static char *nav_saved = NULL;
+
+void histsearch_reset_nav(void) {
+    nav_pos = history_len();
+    free(nav_saved);
+    nav_saved = NULL;
+}
+
+static int nav_prev(int count, int key) {
+    (void)key;
+    if (count <= 0) count = 1;
+    if (nav_pos == 0) {
+        rl_ding();
+        return 0;
+    }
+    if (nav_pos >= history_len()) {
+        free(nav_saved);
+        nav_saved = strdup(rl_line_buffer);
+    }
+    nav_pos = (size_t)count > nav_pos ? 0 : nav_pos - (size_t)count;
+    rl_replace_line(history_at(nav_pos), 0);
+    rl_point = rl_end;
+    return 0;
+}
+
+static int nav_next(int count, int key) {
+    (void)key;
+    if (count <= 0) count = 1;
+    size_t len = history_len();
+    if (nav_pos >= len) {
+        rl_ding();
+        return 0;
+    }
+    nav_pos += (size_t)count;
+    if (nav_pos >= len) {
+        nav_pos = len;
+        rl_replace_line(nav_saved ? nav_saved : "", 0);
+    } else {
+        rl_replace_line(history_at(nav_pos), 0);
+    }
+    rl_point = rl_end;
+    return 0;
+}
+
+void histsearch_bind_keys(void) {
+    // Initialize first so readline's defaults don't override the bindings
+    rl_initialize();
+    rl_bind_key(CTRL('R'), reverse_search);
+    rl_bind_key(CTRL('P'), nav_prev);
+    rl_bind_key(CTRL('N'), nav_next);
+    rl_bind_keyseq("\033[A", nav_prev);
+    rl_bind_keyseq("\033OA", nav_prev);
+    rl_bind_keyseq("\033[B", nav_next);
+    rl_bind_keyseq("\033OB", nav_next);
+}
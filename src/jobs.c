@@ -0,0 +1,656 @@
+// src/jobs.c
+#define _GNU_SOURCE
+#include "jobs.h"
+#include "options.h"
+#include "trace.h"
+#include "datapump.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+static job_t *jobs = NULL;        // Ascending job ids
+static unsigned long job_seq = 0;
+static int job_control = 0;
+static pid_t shell_pgid = 0;
+static struct termios shell_tmodes;
+
+// Interactive shells watch their children through one epoll set: a pidfd
+// per process for exits, a signalfd for SIGCHLD (stops and continues, and
+// exits of processes without a pidfd) and a pipe that pump threads write
+// when they finish. Entries carry the pid, or one of these tags.
+#define EV_SIGCHLD ((uint64_t)-1)
+#define EV_THREADS ((uint64_t)-2)
+#define REAP_BATCH 64
+#define JOIN_KICK_NS 100000000L  // Re-send a pending Ctrl-C to pumps this often
+
+static int epoll_fd = -1;
+static int sigchld_fd = -1;
+static int event_pipe[2] = {-1, -1};
+
+// Per-stage statuses of the last foreground job
+static int *last_statuses = NULL;
+static process_t *last_procs = NULL;
+static size_t last_count = 0;
+
+static int watch_fd(int fd, uint64_t tag) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = tag };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Set up the epoll set; SIGCHLD is blocked and read from the signalfd
+static int init_events(void) {
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) return -1;
+    if (pipe2(event_pipe, O_CLOEXEC | O_NONBLOCK) == -1 || watch_fd(event_pipe[0], EV_THREADS) == -1)
+        return -1;
+    pthread_sigmask(SIG_BLOCK, &chld, NULL);
+    sigchld_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchld_fd == -1 || watch_fd(sigchld_fd, EV_SIGCHLD) == -1) return -1;
+    return 0;
+}
+
+void jobs_init(int interactive) {
+    shell_pgid = getpgrp();
+    if (!interactive) return;
+
+    if (init_events() == -1) perror("jobs: event setup");
+
+    if (!isatty(STDIN_FILENO)) return;
+
+    // Started in the background: wait until we are put in the foreground
+    while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp()))
+        kill(-shell_pgid, SIGTTIN);
+
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    // A session leader already leads its group and cannot move
+    setpgid(0, 0);
+    shell_pgid = getpgrp();
+    if (tcsetpgrp(STDIN_FILENO, shell_pgid) == -1) {
+        perror("tcsetpgrp");
+        return;
+    }
+    tcgetattr(STDIN_FILENO, &shell_tmodes);
+    job_control = 1;
+}
+
+int jobs_control_enabled(void) {
+    return job_control;
+}
+
+void jobs_reclaim_terminal(void) {
+    if (job_control) tcsetpgrp(STDIN_FILENO, shell_pgid);
+}
+
+int jobs_event_fd(void) {
+    return epoll_fd;
+}
+
+job_t *job_create(const char *command, size_t nprocs) {
+    job_t *job = calloc(1, sizeof(job_t));
+    if (!job) return NULL;
+    job->command = strdup(command ? command : "");
+    job->procs = calloc(nprocs, sizeof(process_t));
+    if (!job->command || !job->procs) {
+        free(job->command);
+        free(job->procs);
+        free(job);
+        return NULL;
+    }
+    // Stages count as failed until they start
+    for (size_t i = 0; i < nprocs; i++) {
+        job->procs[i].state = PROC_DONE;
+        job->procs[i].status = 1;
+        job->procs[i].pidfd = -1;
+    }
+    job->nprocs = nprocs;
+    job->seq = ++job_seq;
+
+    // Lowest id above every existing job, appended to keep the list sorted
+    job_t **tail = &jobs;
+    int id = 1;
+    for (; *tail; tail = &(*tail)->next)
+        id = (*tail)->id + 1;
+    job->id = id;
+    *tail = job;
+    return job;
+}
+
+void job_set_pid(job_t *job, size_t i, pid_t pid) {
+    if (!job || i >= job->nprocs) return;
+    process_t *p = &job->procs[i];
+    p->pid = pid;
+    p->state = PROC_RUNNING;
+    p->status = 0;
+    clock_gettime(CLOCK_MONOTONIC, &p->started);
+    if (job->pgid == 0 && job_control) job->pgid = pid;
+
+    // Without a pidfd the process is found by scanning on SIGCHLD
+    if (epoll_fd != -1 && (p->pidfd = pidfd_open(pid, 0)) != -1 &&
+        watch_fd(p->pidfd, (uint64_t)pid) == -1) {
+        close(p->pidfd);
+        p->pidfd = -1;
+    }
+}
+
+// Closing the pidfd also takes it out of the epoll set
+static void close_pidfd(process_t *p) {
+    if (p->pidfd == -1) return;
+    close(p->pidfd);
+    p->pidfd = -1;
+}
+
+void job_add_thread(job_t *job, pthread_t thread) {
+    __atomic_add_fetch(&job->threads_active, 1, __ATOMIC_RELAXED);
+    pthread_t *tmp = realloc(job->threads, (job->nthreads + 1) * sizeof(pthread_t));
+    if (!tmp) {
+        // Cannot track it; wait for it here instead
+        pthread_join(thread, NULL);
+        return;
+    }
+    job->threads = tmp;
+    job->threads[job->nthreads++] = thread;
+}
+
+// Called on the pump thread as its last access to the job
+void job_thread_done(job_t *job) {
+    __atomic_store_n(&job->changed, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&job->threads_active, 1, __ATOMIC_RELEASE);
+    if (event_pipe[1] != -1) {
+        ssize_t n = write(event_pipe[1], "t", 1);
+        (void)n;
+    }
+}
+
+// Pumps finish soon after the processes around them exit
+static void join_threads(job_t *job) {
+    for (size_t i = 0; i < job->nthreads; i++) {
+        // A pump can miss the Ctrl-C wake-up by a hair; it gets another
+        struct timespec until;
+        do {
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += JOIN_KICK_NS;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            datapump_kick();
+        } while (pthread_timedjoin_np(job->threads[i], NULL, &until) == ETIMEDOUT);
+    }
+    free(job->threads);
+    job->threads = NULL;
+    job->nthreads = 0;
+}
+
+void job_discard(job_t *job) {
+    join_threads(job);
+    for (size_t i = 0; i < job->nprocs; i++) close_pidfd(&job->procs[i]);
+    for (job_t **p = &jobs; *p; p = &(*p)->next) {
+        if (*p == job) {
+            *p = job->next;
+            break;
+        }
+    }
+    free(job->command);
+    free(job->procs);
+    free(job);
+}
+
+static void trace_wait(pid_t pid, int wstatus) {
+    if (WIFEXITED(wstatus))
+        trace_record(TRACE_WAIT, pid, WEXITSTATUS(wstatus), "exited");
+    else if (WIFSIGNALED(wstatus))
+        trace_record(TRACE_WAIT, pid, 128 + WTERMSIG(wstatus), "killed");
+    else if (WIFSTOPPED(wstatus))
+        trace_record(TRACE_WAIT, pid, 128 + WSTOPSIG(wstatus), "stopped");
+    else if (WIFCONTINUED(wstatus))
+        trace_record(TRACE_WAIT, pid, 0, "continued");
+}
+
+// Record a wait4 result; usage is the process's total once it has ended
+static void update_process(process_t *p, int wstatus, const struct rusage *usage) {
+    if (trace_active) trace_wait(p->pid, wstatus);
+    if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        p->real = (now.tv_sec - p->started.tv_sec) + (now.tv_nsec - p->started.tv_nsec) / 1e9;
+        p->usage = *usage;
+        close_pidfd(p);
+    }
+    if (WIFEXITED(wstatus)) {
+        p->state = PROC_DONE;
+        p->status = WEXITSTATUS(wstatus);
+        p->signal = 0;
+    } else if (WIFSIGNALED(wstatus)) {
+        p->state = PROC_DONE;
+        p->signal = WTERMSIG(wstatus);
+        p->status = 128 + p->signal;
+    } else if (WIFSTOPPED(wstatus)) {
+        p->state = PROC_STOPPED;
+        p->signal = WSTOPSIG(wstatus);
+        p->status = 128 + p->signal;
+    } else if (WIFCONTINUED(wstatus)) {
+        p->state = PROC_RUNNING;
+        p->signal = 0;
+    }
+}
+
+static int procs_running(const job_t *job) {
+    for (size_t i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].state == PROC_RUNNING) return 1;
+    }
+    return 0;
+}
+
+// Done once every stage and pump is; stopped as soon as any stage is
+static proc_state_t job_state(const job_t *job) {
+    for (size_t i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].state == PROC_STOPPED) return PROC_STOPPED;
+    }
+    if (procs_running(job) || __atomic_load_n(&job->threads_active, __ATOMIC_ACQUIRE) > 0)
+        return PROC_RUNNING;
+    return PROC_DONE;
+}
+
+// Last stage's status, or with pipefail the rightmost non-zero one
+static int job_status(const job_t *job) {
+    if (option_enabled(OPT_PIPEFAIL)) {
+        for (size_t i = job->nprocs; i-- > 0;) {
+            if (job->procs[i].status != 0) return job->procs[i].status;
+        }
+        return 0;
+    }
+    return job->nprocs ? job->procs[job->nprocs - 1].status : 0;
+}
+
+static void save_statuses(const job_t *job) {
+    if (job->nprocs > last_count) {
+        int *tmp = realloc(last_statuses, job->nprocs * sizeof(int));
+        if (!tmp) return;
+        last_statuses = tmp;
+        process_t *procs = realloc(last_procs, job->nprocs * sizeof(process_t));
+        if (!procs) return;
+        last_procs = procs;
+    }
+    for (size_t i = 0; i < job->nprocs; i++)
+        last_statuses[i] = job->procs[i].status;
+    memcpy(last_procs, job->procs, job->nprocs * sizeof(process_t));
+    last_count = job->nprocs;
+}
+
+size_t jobs_pipestatus(const int **statuses) {
+    *statuses = last_statuses;
+    return last_count;
+}
+
+size_t jobs_last_procs(const process_t **procs) {
+    *procs = last_procs;
+    return last_count;
+}
+
+// Current (+) and previous (-) jobs by most recent activity
+static void current_jobs(job_t **cur, job_t **prev) {
+    *cur = *prev = NULL;
+    for (job_t *j = jobs; j; j = j->next) {
+        if (!*cur || j->seq > (*cur)->seq) {
+            *prev = *cur;
+            *cur = j;
+        } else if (!*prev || j->seq > (*prev)->seq) {
+            *prev = j;
+        }
+    }
+}
+
+static char job_marker(const job_t *job) {
+    job_t *cur, *prev;
+    current_jobs(&cur, &prev);
+    return job == cur ? '+' : job == prev ? '-' : ' ';
+}
+
+static void describe(const job_t *job, char *buf, size_t size) {
+    const process_t *last = &job->procs[job->nprocs - 1];
+    switch (job_state(job)) {
+        case PROC_RUNNING:
+            snprintf(buf, size, "Running");
+            break;
+        case PROC_STOPPED:
+            snprintf(buf, size, "Stopped");
+            break;
+        case PROC_DONE:
+            if (last->signal)
+                snprintf(buf, size, "%s", strsignal(last->signal));
+            else if (last->status)
+                snprintf(buf, size, "Exit %d", last->status);
+            else
+                snprintf(buf, size, "Done");
+            break;
+    }
+}
+
+static void print_job(const job_t *job) {
+    char state[64];
+    describe(job, state, sizeof(state));
+    printf("[%d]%c  %-22s %s%s\n", job->id, job_marker(job), state, job->command,
+           job_state(job) == PROC_RUNNING ? " &" : "");
+}
+
+static void continue_job(job_t *job) {
+    for (size_t i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].state == PROC_STOPPED) {
+            job->procs[i].state = PROC_RUNNING;
+            job->procs[i].signal = 0;
+        }
+    }
+    if (job->pgid > 0 && job_control) {
+        kill(-job->pgid, SIGCONT);
+    } else {
+        for (size_t i = 0; i < job->nprocs; i++) {
+            if (job->procs[i].state == PROC_RUNNING) kill(job->procs[i].pid, SIGCONT);
+        }
+    }
+}
+
+// Wait for the next state change among job's stages. With job control the
+// stages share a process group and are waited as one; otherwise the first
+// running pid is waited.
+static pid_t wait_job(const job_t *job, int *wstatus, struct rusage *usage) {
+    if (job_control && job->pgid > 0)
+        return wait4(-job->pgid, wstatus, WUNTRACED, usage);
+    for (size_t i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].state == PROC_RUNNING)
+            return wait4(job->procs[i].pid, wstatus, WUNTRACED, usage);
+    }
+    errno = ECHILD;
+    return -1;
+}
+
+int job_wait_foreground(job_t *job, int cont) {
+    if (!job) return -1;
+
+    int own_terminal = job_control && job->pgid > 0;
+    if (own_terminal) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+        if (cont && job->has_tmodes)
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &job->tmodes);
+    }
+    if (cont) continue_job(job);
+    job->seq = ++job_seq;
+
+    // One loop reaps the stages in the order they finish
+    while (procs_running(job) && job_state(job) != PROC_STOPPED) {
+        int wstatus;
+        struct rusage usage;
+        pid_t r = wait_job(job, &wstatus, &usage);
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            for (size_t i = 0; i < job->nprocs; i++) {
+                if (job->procs[i].state == PROC_RUNNING) job->procs[i].state = PROC_DONE;
+            }
+            break;
+        }
+        for (size_t i = 0; i < job->nprocs; i++) {
+            if (job->procs[i].pid == r) {
+                update_process(&job->procs[i], wstatus, &usage);
+                break;
+            }
+        }
+    }
+
+    if (own_terminal) {
+        if (job_state(job) == PROC_STOPPED) {
+            tcgetattr(STDIN_FILENO, &job->tmodes);
+            job->has_tmodes = 1;
+        }
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+    }
+
+    // Pumps end once the processes around them have
+    if (job_state(job) != PROC_STOPPED) join_threads(job);
+    int status = job_status(job);
+    save_statuses(job);
+    if (job_state(job) == PROC_STOPPED) {
+        // The other stages may still be on their way to stopping
+        for (size_t i = 0; i < job->nprocs; i++) {
+            if (job->procs[i].state == PROC_STOPPED) status = job->procs[i].status;
+        }
+        job->seq = ++job_seq;
+        job->changed = 0;
+        printf("\n");
+        print_job(job);
+        return status;
+    }
+
+    // Deaths by signal are reported, except the ones a user causes routinely
+    int sig = job->procs[job->nprocs - 1].signal;
+    if (sig && sig != SIGINT && sig != SIGPIPE)
+        fprintf(stderr, "%s\n", strsignal(sig));
+    else if (sig == SIGINT)
+        fputc('\n', stderr);
+
+    job_discard(job);
+    return status;
+}
+
+void job_run_background(job_t *job, int cont) {
+    if (!job) return;
+    if (cont) {
+        continue_job(job);
+        printf("[%d]+ %s &\n", job->id, job->command);
+    } else if (job_control && job->pgid > 0) {
+        printf("[%d] %d\n", job->id, (int)job->pgid);
+    } else if (job_control) {
+        // Only pumps: no process to name
+        printf("[%d]\n", job->id);
+    }
+    job->seq = ++job_seq;
+}
+
+static process_t *find_process(pid_t pid, job_t **owner) {
+    for (job_t *job = jobs; job; job = job->next) {
+        for (size_t i = 0; i < job->nprocs; i++) {
+            if (job->procs[i].pid == pid) {
+                *owner = job;
+                return &job->procs[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static void poll_process(job_t *job, process_t *p, int flags) {
+    int wstatus;
+    struct rusage usage;
+    pid_t r = wait4(p->pid, &wstatus, WNOHANG | flags, &usage);
+    if (r == p->pid) {
+        update_process(p, wstatus, &usage);
+        job->changed = 1;
+    } else if (r == -1 && errno == ECHILD) {
+        close_pidfd(p);
+        p->state = PROC_DONE;
+        job->changed = 1;
+    }
+}
+
+// Poll every live process; all_procs: also those a pidfd is watching
+static void scan_processes(int all_procs) {
+    for (job_t *job = jobs; job; job = job->next) {
+        for (size_t i = 0; i < job->nprocs; i++) {
+            process_t *p = &job->procs[i];
+            if (p->pid <= 0 || p->state == PROC_DONE) continue;
+            if (all_procs || p->pidfd == -1) poll_process(job, p, WUNTRACED | WCONTINUED);
+        }
+    }
+}
+
+// Stops and continues, which pidfds do not report. Exits are left alone.
+static void reap_stops(void) {
+    for (;;) {
+        siginfo_t info = {0};
+        if (waitid(P_ALL, 0, &info, WSTOPPED | WCONTINUED | WNOHANG) == -1 || info.si_pid == 0)
+            return;
+        job_t *job;
+        process_t *p = find_process(info.si_pid, &job);
+        if (!p) continue;
+        if (info.si_code == CLD_CONTINUED) {
+            p->state = PROC_RUNNING;
+            p->signal = 0;
+        } else {
+            p->state = PROC_STOPPED;
+            p->signal = info.si_status;
+            p->status = 128 + p->signal;
+        }
+        job->changed = 1;
+    }
+}
+
+void jobs_reap(void) {
+    if (epoll_fd == -1) {
+        scan_processes(1);
+        return;
+    }
+
+    // Level-triggered: whatever is left over wakes the caller again
+    struct epoll_event events[REAP_BATCH];
+    int n = epoll_wait(epoll_fd, events, REAP_BATCH, 0);
+    for (int i = 0; i < n; i++) {
+        uint64_t tag = events[i].data.u64;
+        if (tag == EV_THREADS) {
+            char buf[64];
+            while (read(event_pipe[0], buf, sizeof(buf)) > 0) continue;
+        } else if (tag == EV_SIGCHLD) {
+            // Signals coalesce: the siginfo is not worth reading
+            struct signalfd_siginfo si[16];
+            ssize_t got;
+            long count = 0;
+            while ((got = read(sigchld_fd, si, sizeof(si))) > 0) count += got / (ssize_t)sizeof(si[0]);
+            TRACE(TRACE_SIGNAL, SIGCHLD, count, "SIGCHLD");
+            reap_stops();
+            scan_processes(0);
+        } else {
+            job_t *job;
+            process_t *p = find_process((pid_t)tag, &job);
+            if (p) poll_process(job, p, 0);
+        }
+    }
+}
+
+size_t jobs_count(void) {
+    size_t count = 0;
+    for (job_t *job = jobs; job; job = job->next) count++;
+    return count;
+}
+
+int jobs_pending(void) {
+    if (!job_control) return 0;
+    for (job_t *job = jobs; job; job = job->next) {
+        if (job->changed && job_state(job) != PROC_RUNNING) return 1;
+    }
+    return 0;
+}
+
+int jobs_notify(void) {
+    int printed = 0;
+    job_t *job = jobs;
+    while (job) {
+        job_t *next = job->next;
+        proc_state_t state = job_state(job);
+        if (state == PROC_DONE) join_threads(job);
+        if (job->changed && state != PROC_RUNNING && job_control) {
+            print_job(job);
+            printed++;
+        }
+        job->changed = 0;
+        if (state == PROC_DONE) job_discard(job);
+        job = next;
+    }
+    fflush(stdout);
+    return printed;
+}
+
+job_t *job_find(const char *spec) {
+    job_t *cur, *prev;
+    current_jobs(&cur, &prev);
+    if (!spec || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0 || strcmp(spec, "%") == 0)
+        return cur;
+    if (strcmp(spec, "%-") == 0)
+        return prev;
+
+    if (*spec == '%') spec++;
+    char *end;
+    long id = strtol(spec, &end, 10);
+    if (*spec == '\0' || *end != '\0') return NULL;
+    for (job_t *j = jobs; j; j = j->next) {
+        if (j->id == id) return j;
+    }
+    return NULL;
+}
+
+void jobs_print(void) {
+    jobs_reap();
+    for (job_t *job = jobs; job; job = job->next) {
+        if (job_state(job) == PROC_DONE) join_threads(job);
+        print_job(job);
+        job->changed = 0;
+    }
+    // Finished jobs are listed once, then dropped
+    job_t *job = jobs;
+    while (job) {
+        job_t *next = job->next;
+        if (job_state(job) == PROC_DONE) job_discard(job);
+        job = next;
+    }
+}
+
+void jobs_free(void) {
+    int pumping = 0;
+    for (job_t *job = jobs, *next; job; job = next) {
+        next = job->next;
+        // A stopped job would never run again
+        if (job_state(job) == PROC_STOPPED && job->pgid > 0 && job_control) {
+            kill(-job->pgid, SIGHUP);
+            kill(-job->pgid, SIGCONT);
+        }
+        // Pumps still copying die with the process: waiting could take
+        // forever (`tail -f log | cat > out &`). Their job stays allocated
+        // for their last job_thread_done()
+        if (__atomic_load_n(&job->threads_active, __ATOMIC_ACQUIRE) > 0) {
+            for (size_t i = 0; i < job->nthreads; i++) pthread_detach(job->threads[i]);
+            job->nthreads = 0;
+            pumping = 1;
+            continue;
+        }
+        job_discard(job);
+    }
+    free(last_statuses);
+    free(last_procs);
+    last_statuses = NULL;
+    last_procs = NULL;
+    last_count = 0;
+    if (event_pipe[0] != -1 && !pumping) {
+        close(event_pipe[0]);
+        close(event_pipe[1]);
+        event_pipe[0] = event_pipe[1] = -1;
+    }
+    if (sigchld_fd != -1) close(sigchld_fd);
+    if (epoll_fd != -1) close(epoll_fd);
+    sigchld_fd = epoll_fd = -1;
+}
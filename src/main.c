@@ -11,14 +11,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
-#include <ctype.h>
 #include <limits.h>
-#include <dirent.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <pwd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <readline/readline.h>
-#include <readline/history.h>
 
 #include "parser.h"
 #include "executor.h"
@@ -27,19 +29,17 @@
 #include "config.h"
 #include "prompt.h"
 #include "utils.h" 
+#include "pathindex.h"
+#include "histsearch.h"
+#include "script.h"
+#include "jobs.h"
+#include "alias.h"
+#include "cmdcache.h"
+#include "metrics.h"
+#include "trace.h"
 
 static volatile int keep_running = 1;
 
-// Alias structure
-typedef struct alias {
-    char *name;
-    char *command;
-} alias_t;
-
-#define MAX_ALIASES 64
-static alias_t aliases[MAX_ALIASES];
-static size_t alias_count = 0;
-
 // List of builtin commands for completion
 static const char *builtin_commands[] = {
     "cd",
@@ -50,6 +50,14 @@ static const char *builtin_commands[] = {
     "jobs",
     "fg",
     "bg",
+    "hash",
+    "set",
+    "pipestatus",
+    "cmdcache",
+    "time",
+    "metrics",
+    "trace",
+    "parallel",
     NULL
 };
 
@@ -58,258 +66,236 @@ static shell_config_t shell_config;
 
 #define PROMPT_BUFFER_SIZE 512
 
+// The interactive loop waits on one epoll set; readline is fed a key at a
+// time through its callback interface. Signals arrive as ordinary events:
+// SIGINT through a signalfd, SIGCHLD through the jobs module's own set.
+typedef enum {
+    EV_TERMINAL,
+    EV_SIGINT,
+    EV_JOBS,                      // Children exited or stopped, pumps finished
+    EV_PROMPT,                    // A late prompt segment arrived
+    EV_CONFIG,                    // ~/.kali_shellrc may have changed
+    EV_SOURCES
+} event_source_t;
+
+static int loop_fd = -1;
+static int watched[EV_SOURCES] = { -1, -1, -1, -1, -1 };
+static int terminal_watched = 0;  // 0 if stdin cannot be polled (a file)
+static int sigint_fd = -1;
+
+static char *accepted_line = NULL;
+static int line_ready = 0;
+
+// Re-read ~/.kali_shellrc after it changed: prompt, theme and aliases
+static void reload_config(void) {
+    config_init(&shell_config);
+    config_load(&shell_config);
+    prompt_compile(&shell_config);
+}
 
+// Update the prompt being edited if a segment changed since it was drawn.
+// Returns 1 if it did.
+static int refresh_prompt(void) {
+    char prompt_buf[PROMPT_BUFFER_SIZE];
+    prompt_refresh(prompt_buf, sizeof(prompt_buf), &shell_config);
+    if (rl_prompt && strcmp(prompt_buf, rl_prompt) == 0) return 0;
+    rl_set_prompt(prompt_buf);
+    return 1;
+}
 
-// Signal handler for Ctrl-C to print prompt on new line (to avoid ^C breaking prompt line)
-void sigint_handler(int signo) {
-    (void)signo;
-    const char prompt_str[] = "\n";
-    write(STDOUT_FILENO, prompt_str, sizeof(prompt_str) - 1);
-    rl_replace_line("", 0);
+// Draw the line being edited again from the start of the terminal line
+static void redraw_line(void) {
+    fputs("\r\033[K", stdout);
     rl_on_new_line();
     rl_redisplay();
 }
 
-// Signal handler for SIGCHLD: notify when background job finishes
-void sigchld_handler(int signo) {
-    (void)signo;
-    int status;
-    pid_t pid;
-
-    // Reap all finished child processes
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        if (WIFEXITED(status)) {
-            printf("\n[+] Job %d exited with status %d\n", pid, WEXITSTATUS(status));
-        } else if (WIFSIGNALED(status)) {
-            printf("\n[+] Job %d terminated by signal %d\n", pid, WTERMSIG(status));
-        }
-        rl_on_new_line();
-        rl_replace_line("", 0);
-        rl_redisplay();
-    }
+// Watch fd for source, replacing the fd watched before. Some sources only
+// get an fd once first used.
+static int watch(event_source_t source, int fd) {
+    if (loop_fd == -1 || watched[source] == fd) return 0;
+    if (watched[source] != -1) epoll_ctl(loop_fd, EPOLL_CTL_DEL, watched[source], NULL);
+    watched[source] = -1;
+    if (fd == -1) return 0;
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = source };
+    if (epoll_ctl(loop_fd, EPOLL_CTL_ADD, fd, &ev) == -1) return -1;
+    watched[source] = fd;
+    return 0;
 }
 
-// Load aliases from ~/.kali_shellrc config file, lines starting with "alias "
-void load_aliases() {
-    char *home = getenv("HOME");
-    if (!home)
-        return;
-
-    char path[PATH_MAX];
-    snprintf(path, sizeof(path), "%s/.kali_shellrc", home);
+// 1 if a SIGINT was pending (and is now consumed)
+static int take_sigint(void) {
+    struct signalfd_siginfo si;
+    int got = 0;
+    while (sigint_fd != -1 && read(sigint_fd, &si, sizeof(si)) == sizeof(si)) got++;
+    if (got) TRACE(TRACE_SIGNAL, SIGINT, got, "SIGINT");
+    return got > 0;
+}
 
-    FILE *f = fopen(path, "r");
-    if (!f)
-        return;
+// Ctrl-C while editing: drop the line and start over on a fresh one
+static void interrupt_line(void) {
+    rl_callback_sigcleanup();
+    rl_replace_line("", 0);
+    rl_crlf();
+    rl_on_new_line();
+    rl_redisplay();
+}
 
-    char line[512];
-    while (fgets(line, sizeof(line), f)) {
-        char *trimline = trim_whitespace(line);
-        if (strncmp(trimline, "alias ", 6) == 0) {
-            char *alias_def = trimline + 6;
-            char *eq = strchr(alias_def, '=');
-            if (!eq)
-                continue;
-
-            *eq = '\0';
-            char *name = trim_whitespace(alias_def);
-            char *cmd = trim_whitespace(eq + 1);
-
-            size_t len = strlen(cmd);
-            if ((cmd[0] == '\'' && cmd[len - 1] == '\'') || (cmd[0] == '"' && cmd[len - 1] == '"')) {
-                cmd[len - 1] = '\0';
-                cmd++;
+static void handle_event(event_source_t source) {
+    switch (source) {
+        case EV_TERMINAL:
+            rl_callback_read_char();
+            break;
+        case EV_SIGINT:
+            if (take_sigint()) interrupt_line();
+            break;
+        case EV_JOBS:
+            jobs_reap();
+            // Report below the line being edited, then redraw it
+            if (jobs_pending()) {
+                fputc('\n', stdout);
+                jobs_notify();
+                refresh_prompt();
+                rl_on_new_line();
+                rl_redisplay();
             }
-
-            if (alias_count < MAX_ALIASES) {
-                aliases[alias_count].name = strdup(name);
-                aliases[alias_count].command = strdup(cmd);
-                alias_count++;
+            break;
+        case EV_PROMPT:
+            prompt_event_clear();
+            if (refresh_prompt()) redraw_line();
+            break;
+        case EV_CONFIG:
+            if (config_changed()) {
+                reload_config();
+                if (refresh_prompt()) redraw_line();
             }
-            *eq = '=';
-        }
+            break;
+        case EV_SOURCES:
+            break;
     }
-
-    fclose(f);
 }
 
-// Expand aliases in input line, only first token; returns newly malloc'ed string
-char *expand_aliases(const char *input) {
-    if (!input || !*input)
-        return strdup(input);
-
-    const char *space = strchr(input, ' ');
-    size_t first_len = space ? (size_t)(space - input) : strlen(input);
-
-    for (size_t i = 0; i < alias_count; i++) {
-        if (strlen(aliases[i].name) == first_len && strncmp(input, aliases[i].name, first_len) == 0) {
-            const char *rest = input + first_len;
-            while (*rest && isspace((unsigned char)*rest))
-                rest++;
-            size_t len = strlen(aliases[i].command) + (rest ? strlen(rest) : 0) + 2;
-            char *expanded = malloc(len);
-            if (!expanded) return strdup(input);
-            strcpy(expanded, aliases[i].command);
-            if (*rest) {
-                strcat(expanded, " ");
-                strcat(expanded, rest);
-            }
-            return expanded;
+// readline input hook, used when a key binding waits for further keys (the
+// reverse search, multi-key sequences). Ctrl-C there acts as Ctrl-G (abort).
+static int shell_getc(FILE *in) {
+    for (;;) {
+        struct pollfd fds[2] = {
+            { .fd = fileno(in), .events = POLLIN },
+            { .fd = sigint_fd, .events = POLLIN },
+        };
+        if (poll(fds, 2, -1) == -1) {
+            if (errno != EINTR) return EOF;
+            rl_check_signals();
+            continue;
         }
+        if (fds[0].revents) return rl_getc(in);
+        if (take_sigint()) return CTRL('G');
     }
-
-    return strdup(input);
 }
 
-// Returns 1 if path is executable
-static int is_executable(const char *path) {
-    return access(path, X_OK) == 0;
+// Called by readline with a finished line (NULL at end of input). The
+// handler is removed so the terminal is back in its normal mode while the
+// line runs.
+static void line_handler(char *line) {
+    rl_callback_handler_remove();
+    accepted_line = line;
+    line_ready = 1;
 }
 
-// Search PATH dirs for executables matching prefix
-static char **get_path_executables(const char *prefix) {
-    char *path_env = getenv("PATH");
-    if (!path_env) return NULL;
-
-    char **matches = NULL;
-    size_t matches_size = 0, matches_cap = 16;
-    matches = malloc(matches_cap * sizeof(char *));
-    if (!matches) return NULL;
-
-    char *path_env_dup = strdup(path_env);
-    if (!path_env_dup) {
-        free(matches);
-        return NULL;
-    }
-
-    char *saveptr = NULL;
-    char *dir = strtok_r(path_env_dup, ":", &saveptr);
-
-    while (dir) {
-        DIR *dp = opendir(dir);
-        if (dp) {
-            struct dirent *entry;
-            while ((entry = readdir(dp)) != NULL) {
-                if (entry->d_type != DT_REG && entry->d_type != DT_LNK)
-                    continue;
-
-                if (strncmp(entry->d_name, prefix, strlen(prefix)) == 0) {
-                    size_t fullpathlen = strlen(dir) + 1 + strlen(entry->d_name) + 1;
-                    char *fullpath = malloc(fullpathlen);
-                    if (!fullpath) continue;
-                    snprintf(fullpath, fullpathlen, "%s/%s", dir, entry->d_name);
-                    if (is_executable(fullpath)) {
-                        if (matches_size >= matches_cap) {
-                            matches_cap *= 2;
-                            char **tmp = realloc(matches, matches_cap * sizeof(char *));
-                            if (!tmp) {
-                                free(fullpath);
-                                closedir(dp);
-                                dir = NULL;
-                                break;
-                            }
-                            matches = tmp;
-                        }
-                        matches[matches_size++] = strdup(entry->d_name);
-                    }
-                    free(fullpath);
-                }
-            }
-            closedir(dp);
+// Show a fresh prompt and run the event loop until a line is entered.
+// Returns it (malloc'ed), or NULL at end of input.
+static char *read_line(void) {
+    if (config_changed()) reload_config();
+
+    jobs_reap();
+    jobs_notify();
+
+    char prompt_buf[PROMPT_BUFFER_SIZE];
+    prompt_render(prompt_buf, sizeof(prompt_buf), &shell_config);
+
+    histsearch_reset_nav();
+    line_ready = 0;
+    accepted_line = NULL;
+    rl_callback_handler_install(prompt_buf, line_handler);
+
+    while (!line_ready) {
+        watch(EV_PROMPT, prompt_event_fd());
+        watch(EV_CONFIG, config_watch());
+
+        // A file on stdin cannot be polled: read it key by key, looking
+        // for other events in between
+        int timeout = terminal_watched ? -1 : 0;
+        struct epoll_event events[EV_SOURCES];
+        int n = loop_fd != -1 ? epoll_wait(loop_fd, events, EV_SOURCES, timeout) : 0;
+        if (n == -1) {
+            if (errno != EINTR) break;
+            rl_check_signals();
+            continue;
+        }
+        // The terminal goes last: a line it completes runs right away
+        int terminal = !terminal_watched;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u32 == EV_TERMINAL)
+                terminal = 1;
+            else
+                handle_event(events[i].data.u32);
         }
-        if (!dir) break;
-        dir = strtok_r(NULL, ":", &saveptr);
+        if (terminal) handle_event(EV_TERMINAL);
     }
+    if (!line_ready) rl_callback_handler_remove();
+    return accepted_line;
+}
 
-    free(path_env_dup);
-
-    if (matches_size == 0) {
-        free(matches);
-        return NULL;
+// Block SIGINT for the signalfd and set up the epoll set. Runs before any
+// thread starts, so every thread inherits the mask.
+static void init_event_loop(void) {
+    sigset_t sigint;
+    sigemptyset(&sigint);
+    sigaddset(&sigint, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigint, NULL);
+    sigint_fd = signalfd(-1, &sigint, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    loop_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop_fd == -1) {
+        perror("epoll_create1");
+        return;
     }
+    terminal_watched = (watch(EV_TERMINAL, STDIN_FILENO) == 0);
+    watch(EV_SIGINT, sigint_fd);
+}
 
-    matches[matches_size] = NULL;
-    return matches;
+static void free_event_loop(void) {
+    if (loop_fd != -1) close(loop_fd);
+    if (sigint_fd != -1) close(sigint_fd);
+    loop_fd = sigint_fd = -1;
 }
 
 // Command generator for first word completion (builtins + executables)
 static char *command_generator(const char *text, int state) {
-    static int list_index, len;
-    static char **matches = NULL;
+    static size_t builtin_index, path_index, path_count, len;
+    static const char *const *path_names;
 
     if (state == 0) {
-        list_index = 0;
+        builtin_index = 0;
+        path_index = 0;
         len = strlen(text);
 
-        size_t capacity = 32;
-        matches = malloc(capacity * sizeof(char *));
-        if (!matches) return NULL;
-
-        size_t count = 0;
-
-        // Add builtin commands
-        for (const char **cmd = builtin_commands; *cmd; cmd++) {
-            if (strncmp(*cmd, text, len) == 0) {
-                if (count >= capacity) {
-                    capacity *= 2;
-                    char **tmp = realloc(matches, capacity * sizeof(char *));
-                    if (!tmp) {
-                        for (size_t i = 0; i < count; i++) free(matches[i]);
-                        free(matches);
-                        matches = NULL;
-                        return NULL;
-                    }
-                    matches = tmp;
-                }
-                matches[count++] = strdup(*cmd);
-            }
-        }
-
-        // Add executables in PATH
-        char **path_matches = get_path_executables(text);
-        if (path_matches) {
-            for (size_t i = 0; path_matches[i] != NULL; i++) {
-                if (count >= capacity) {
-                    capacity *= 2;
-                    char **tmp = realloc(matches, capacity * sizeof(char *));
-                    if (!tmp) {
-                        for (size_t j = 0; j < count; j++) free(matches[j]);
-                        free(matches);
-                        matches = NULL;
-                        for (size_t j = i; path_matches[j] != NULL; j++) free(path_matches[j]);
-                        free(path_matches);
-                        return NULL;
-                    }
-                    matches = tmp;
-                }
-                matches[count++] = strdup(path_matches[i]);
-                free(path_matches[i]);
-            }
-            free(path_matches);
-        }
-
-        if (count == 0) {
-            free(matches);
-            matches = NULL;
-            return NULL;
-        }
-
-        matches[count] = NULL;
+        // Executables come from the prebuilt PATH index as one sorted run
+        pathindex_refresh();
+        path_count = pathindex_prefix(text, &path_names);
     }
 
-    if (!matches) return NULL;
-
-    char *result = matches[list_index];
-    if (result)
-        list_index++;
-    else {
-        for (int i = 0; matches[i] != NULL; i++)
-            free(matches[i]);
-        free(matches);
-        matches = NULL;
+    while (builtin_commands[builtin_index]) {
+        const char *cmd = builtin_commands[builtin_index++];
+        if (strncmp(cmd, text, len) == 0)
+            return strdup(cmd);
     }
 
-    return result;
+    if (path_index < path_count)
+        return strdup(path_names[path_index++]);
+
+    return NULL;
 }
 
 // Readline completion function
@@ -322,35 +308,61 @@ char **kali_shell_completion(const char *text, int start, int end) {
     }
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    // Writes to a closed pipe fail with EPIPE instead of killing the shell;
+    // children get the default action back from the spawn engine
+    signal(SIGPIPE, SIG_IGN);
+    trace_init();
+
+    // Non-interactive modes skip config, history and readline entirely
+    if (argc > 1) {
+        int status;
+        if (strcmp(argv[1], "-c") == 0) {
+            if (argc < 3) {
+                fprintf(stderr, "kali_shell: -c: option requires an argument\n");
+                return 2;
+            }
+            status = script_run_string(argv[2]);
+        } else {
+            status = script_run_file(argv[1]);
+        }
+        // Background pumps still copying would die with the process
+        jobs_free();
+        metrics_free();
+        trace_free();
+        return status;
+    }
+
     // Initialize shell configuration with defaults and load config
+    // (settings and aliases), then watch it for edits
     config_init(&shell_config);
     config_load(&shell_config);
-
-    // Setup Ctrl-C handler
-    struct sigaction sa_int = {0};
-    sa_int.sa_handler = sigint_handler;
-    sigaction(SIGINT, &sa_int, NULL);
-
-    // Setup SIGCHLD handler for job notifications
-    struct sigaction sa_chld = {0};
-    sa_chld.sa_handler = sigchld_handler;
-    sigemptyset(&sa_chld.sa_mask);
-    sa_chld.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa_chld, NULL);
-
-    // Load persistent history, aliases from config
-    history_init(".kali_shell_history");
-    load_aliases();
+    config_watch();
+    prompt_compile(&shell_config);
+
+    // Ctrl-C and SIGCHLD become events; job control takes its own process
+    // group and the terminal
+    init_event_loop();
+    jobs_init(1);
+    watch(EV_JOBS, jobs_event_fd());
+
+    // Load persistent history
+    char history_path[PATH_MAX];
+    const char *home = getenv("HOME");
+    snprintf(history_path, sizeof(history_path), "%s%s.kali_shell_history",
+             home ? home : "", home ? "/" : "");
+    history_init(history_path, shell_config.history_size, shell_config.history_flush);
 
     // Setup readline completion
     rl_attempted_completion_function = kali_shell_completion;
+    rl_getc_function = shell_getc;
+    // Signals are the event loop's business
+    rl_catch_signals = 0;
+    pathindex_init();
+    histsearch_bind_keys();
 
     while (keep_running) {
-        char prompt_buf[PROMPT_BUFFER_SIZE];
-        prompt_render(prompt_buf, sizeof(prompt_buf), &shell_config);
-
-        char *input = readline(prompt_buf);
+        char *input = read_line();
         if (!input) {
             printf("\n");
             break;
@@ -362,38 +374,33 @@ int main(void) {
             continue;
         }
 
-        add_history(trimmed);
+        TRACE(TRACE_LINE, (long long)strlen(trimmed), 0, trimmed);
         history_add(trimmed);
 
-        char *expanded = expand_aliases(trimmed);
-        free(input);
-        input = expanded;
-
-        command_list_t *cmdlist = parse_input(input);
+        struct timespec parse_start;
+        int timed = metrics_enabled();
+        if (timed) clock_gettime(CLOCK_MONOTONIC, &parse_start);
+        command_list_t *cmdlist = cmdcache_get(trimmed);
+        if (timed) metrics_record_parse(cmdlist, &parse_start);
         free(input);
 
         if (!cmdlist) {
-            fprintf(stderr, "parse error\n");
+            const char *reason = parse_error();
+            fprintf(stderr, "parse error%s%s\n", reason ? ": " : "", reason ? reason : "");
             continue;
         }
 
-        for (size_t i = 0; i < cmdlist->count; i++) {
-            command_t *cmd = cmdlist->commands[i];
-
-            if (is_builtin(cmd->argv[0])) {
-                if (builtin_execute(cmd) == SHELL_EXIT) {
-                    keep_running = 0;
-                    break;
-                }
-            } else {
-                int ret = executor_execute(cmd);
-                if (ret < 0) {
-                    fprintf(stderr, "command execution failed\n");
-                }
-            }
-        }
+        struct timespec started, finished;
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        int exit_requested = 0;
+        int status = executor_run_list(cmdlist, &exit_requested);
+        if (exit_requested) keep_running = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+        prompt_command_done(status, (finished.tv_sec - started.tv_sec) +
+                                        (finished.tv_nsec - started.tv_nsec) / 1e9);
 
-        command_list_free(cmdlist);
+        cmdcache_release(cmdlist);
 
         if (!keep_running)
             break;
@@ -401,12 +408,16 @@ int main(void) {
 
     history_save();
     history_free();
-
-    // Free alias memory
-    for (size_t i = 0; i < alias_count; i++) {
-        free(aliases[i].name);
-        free(aliases[i].command);
-    }
-
-    return 0;
+    histsearch_free();
+    pathindex_free();
+    prompt_free();
+    jobs_free();
+    free_event_loop();
+    cmdcache_free();
+    alias_free();
+    metrics_free();
+    trace_free();
+
+    int code = builtin_exit_code();
+    return code >= 0 ? code : 0;
 }
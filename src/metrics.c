@@ -0,0 +1,303 @@
+// src/metrics.c
+#define _GNU_SOURCE
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Log-linear histogram of microseconds: values below 8 get a bucket each,
+// then every power of two is split into 8 equal buckets, so a bucket is
+// never wider than 1/8 of its lower bound. Values past 2^40 us (12 days)
+// land in the last bucket.
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 40
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB)
+
+#define METRICS_COMMANDS 256      // Distinct names; later ones count as "(other)"
+#define METRICS_BUCKETS 128
+#define METRICS_NAME_MAX 64
+
+typedef struct histogram {
+    unsigned int counts[HIST_BUCKETS];
+    unsigned long count;
+    double sum;                   // Seconds
+    double max;
+} histogram_t;
+
+typedef struct command_metrics {
+    char name[METRICS_NAME_MAX];
+    unsigned long runs;
+    unsigned long failures;
+    histogram_t hist[METRIC_COUNT];
+    struct command_metrics *chain;
+} command_metrics_t;
+
+static int enabled = 0;
+static char *dump_path = NULL;
+static command_metrics_t *buckets[METRICS_BUCKETS];
+static command_metrics_t *commands[METRICS_COMMANDS];
+static size_t command_count = 0;
+
+static const char *metric_names[METRIC_COUNT] = { "parse", "spawn", "wall" };
+
+static size_t hist_index(unsigned long long us) {
+    if (us < HIST_SUB) return (size_t)us;
+    if (us >= 1ULL << HIST_MAX_EXP) return HIST_BUCKETS - 1;
+    int exp = 63 - __builtin_clzll(us);
+    return (size_t)(exp - HIST_SUB_BITS + 1) * HIST_SUB + ((us >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+// Exclusive upper bound of bucket i, in microseconds
+static unsigned long long hist_upper(size_t i) {
+    if (i < HIST_SUB) return i + 1;
+    int exp = (int)(i / HIST_SUB) + HIST_SUB_BITS - 1;
+    return (unsigned long long)(HIST_SUB + i % HIST_SUB + 1) << (exp - HIST_SUB_BITS);
+}
+
+static void hist_add(histogram_t *h, double seconds) {
+    if (seconds < 0) seconds = 0;
+    h->counts[hist_index((unsigned long long)(seconds * 1e6))]++;
+    h->count++;
+    h->sum += seconds;
+    if (seconds > h->max) h->max = seconds;
+}
+
+// Upper bound of the bucket holding the q-quantile, capped at the largest
+// sample seen
+static double hist_quantile(const histogram_t *h, double q) {
+    if (h->count == 0) return 0;
+    unsigned long rank = (unsigned long)(q * h->count + 0.999999);
+    if (rank < 1) rank = 1;
+    unsigned long seen = 0;
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            double bound = hist_upper(i) / 1e6;
+            return bound < h->max ? bound : h->max;
+        }
+    }
+    return h->max;
+}
+
+// FNV-1a
+static size_t hash_name(const char *s) {
+    size_t h = 14695981039346656037ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static command_metrics_t *find(const char *name, size_t b) {
+    for (command_metrics_t *m = buckets[b]; m; m = m->chain) {
+        if (strncmp(m->name, name, METRICS_NAME_MAX - 1) == 0) return m;
+    }
+    return NULL;
+}
+
+static command_metrics_t *lookup(const char *command) {
+    const char *name = command ? command : "";
+    const char *slash = strrchr(name, '/');
+    if (slash && slash[1]) name = slash + 1;
+
+    size_t b = hash_name(name) % METRICS_BUCKETS;
+    command_metrics_t *m = find(name, b);
+    if (m) return m;
+    // The last slot is kept for "(other)"
+    if (command_count >= METRICS_COMMANDS - 1) {
+        name = "(other)";
+        b = hash_name(name) % METRICS_BUCKETS;
+        if ((m = find(name, b)) || command_count == METRICS_COMMANDS) return m;
+    }
+
+    m = calloc(1, sizeof(command_metrics_t));
+    if (!m) return NULL;
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    m->chain = buckets[b];
+    buckets[b] = m;
+    commands[command_count++] = m;
+    return m;
+}
+
+int metrics_enabled(void) {
+    return enabled;
+}
+
+void metrics_start(const char *path) {
+    enabled = 1;
+    if (path) {
+        free(dump_path);
+        dump_path = strdup(path);
+    }
+}
+
+void metrics_stop(void) {
+    enabled = 0;
+}
+
+double metrics_elapsed(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+void metrics_record(metric_t metric, const char *command, double seconds) {
+    command_metrics_t *m = lookup(command);
+    if (m) hist_add(&m->hist[metric], seconds);
+}
+
+void metrics_record_parse(const command_list_t *cmdlist, const struct timespec *since) {
+    if (!cmdlist || cmdlist->pipeline_count == 0 || cmdlist->pipelines[0]->count == 0) return;
+    metrics_record(METRIC_PARSE, cmdlist->pipelines[0]->commands[0]->argv[0], metrics_elapsed(since));
+}
+
+void metrics_record_status(const char *command, int status) {
+    command_metrics_t *m = lookup(command);
+    if (!m) return;
+    m->runs++;
+    if (status != 0) m->failures++;
+}
+
+static void format_duration(char *buf, size_t size, double seconds) {
+    if (seconds < 1e-3)
+        snprintf(buf, size, "%.1fus", seconds * 1e6);
+    else if (seconds < 1)
+        snprintf(buf, size, "%.2fms", seconds * 1e3);
+    else
+        snprintf(buf, size, "%.2fs", seconds);
+}
+
+// Most total wall time first
+static int by_wall_time(const void *a, const void *b) {
+    const command_metrics_t *x = *(command_metrics_t *const *)a;
+    const command_metrics_t *y = *(command_metrics_t *const *)b;
+    double dx = x->hist[METRIC_WALL].sum, dy = y->hist[METRIC_WALL].sum;
+    return dx < dy ? 1 : dx > dy ? -1 : strcmp(x->name, y->name);
+}
+
+void metrics_print(void) {
+    if (!enabled && command_count == 0) {
+        printf("metrics are off (metrics on [file] to record)\n");
+        return;
+    }
+    command_metrics_t **sorted = malloc((command_count ? command_count : 1) * sizeof(*sorted));
+    if (!sorted) {
+        perror("malloc");
+        return;
+    }
+    memcpy(sorted, commands, command_count * sizeof(*sorted));
+    qsort(sorted, command_count, sizeof(*sorted), by_wall_time);
+
+    printf("%-16s %6s %6s  %-6s %9s %9s %9s %9s\n", "command", "runs", "failed", "metric", "p50",
+           "p95", "p99", "total");
+    for (size_t i = 0; i < command_count; i++) {
+        const command_metrics_t *m = sorted[i];
+        int first = 1;
+        for (int k = 0; k < METRIC_COUNT; k++) {
+            const histogram_t *h = &m->hist[k];
+            if (h->count == 0) continue;
+            char p50[16], p95[16], p99[16], total[16];
+            format_duration(p50, sizeof(p50), hist_quantile(h, 0.50));
+            format_duration(p95, sizeof(p95), hist_quantile(h, 0.95));
+            format_duration(p99, sizeof(p99), hist_quantile(h, 0.99));
+            format_duration(total, sizeof(total), h->sum);
+            if (first)
+                printf("%-16.16s %6lu %6lu  ", m->name, m->runs, m->failures);
+            else
+                printf("%-16s %6s %6s  ", "", "", "");
+            printf("%-6s %9s %9s %9s %9s\n", metric_names[k], p50, p95, p99, total);
+            first = 0;
+        }
+    }
+    printf("metrics: %s%s%s\n", enabled ? "on" : "off", dump_path ? ", dumped on exit to " : "",
+           dump_path ? dump_path : "");
+    free(sorted);
+}
+
+void metrics_reset(void) {
+    for (size_t i = 0; i < command_count; i++) free(commands[i]);
+    memset(buckets, 0, sizeof(buckets));
+    command_count = 0;
+}
+
+// Label values escape \, " and newlines
+static void write_label(FILE *f, const char *s) {
+    for (; *s; s++) {
+        if (*s == '\\' || *s == '"')
+            fprintf(f, "\\%c", *s);
+        else if (*s == '\n')
+            fputs("\\n", f);
+        else
+            fputc(*s, f);
+    }
+}
+
+static void write_histogram(FILE *f, metric_t k) {
+    static const char *help[METRIC_COUNT] = {
+        "Time to turn a line into a runnable command list, by its first command",
+        "Time to spawn a pipeline stage, by command",
+        "Wall time of foreground pipelines, by first command",
+    };
+    fprintf(f, "# HELP kali_shell_%s_seconds %s\n", metric_names[k], help[k]);
+    fprintf(f, "# TYPE kali_shell_%s_seconds histogram\n", metric_names[k]);
+    for (size_t i = 0; i < command_count; i++) {
+        const command_metrics_t *m = commands[i];
+        const histogram_t *h = &m->hist[k];
+        if (h->count == 0) continue;
+        // Only the bounds that samples fell under; the counts stay cumulative
+        unsigned long seen = 0;
+        for (size_t b = 0; b < HIST_BUCKETS; b++) {
+            if (h->counts[b] == 0) continue;
+            seen += h->counts[b];
+            fprintf(f, "kali_shell_%s_seconds_bucket{command=\"", metric_names[k]);
+            write_label(f, m->name);
+            fprintf(f, "\",le=\"%g\"} %lu\n", hist_upper(b) / 1e6, seen);
+        }
+        fprintf(f, "kali_shell_%s_seconds_bucket{command=\"", metric_names[k]);
+        write_label(f, m->name);
+        fprintf(f, "\",le=\"+Inf\"} %lu\n", h->count);
+        fprintf(f, "kali_shell_%s_seconds_sum{command=\"", metric_names[k]);
+        write_label(f, m->name);
+        fprintf(f, "\"} %.9f\n", h->sum);
+        fprintf(f, "kali_shell_%s_seconds_count{command=\"", metric_names[k]);
+        write_label(f, m->name);
+        fprintf(f, "\"} %lu\n", h->count);
+    }
+}
+
+static void write_counter(FILE *f, const char *name, const char *help, int failures) {
+    fprintf(f, "# HELP kali_shell_%s %s\n# TYPE kali_shell_%s counter\n", name, help, name);
+    for (size_t i = 0; i < command_count; i++) {
+        const command_metrics_t *m = commands[i];
+        if (m->runs == 0) continue;
+        fprintf(f, "kali_shell_%s{command=\"", name);
+        write_label(f, m->name);
+        fprintf(f, "\"} %lu\n", failures ? m->failures : m->runs);
+    }
+}
+
+int metrics_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    write_counter(f, "command_runs_total", "Foreground pipelines run, by first command", 0);
+    write_counter(f, "command_failures_total", "Foreground pipelines with a non-zero status", 1);
+    for (int k = 0; k < METRIC_COUNT; k++) write_histogram(f, (metric_t)k);
+    if (fclose(f) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_free(void) {
+    if (dump_path && command_count > 0) metrics_dump(dump_path);
+    metrics_reset();
+    free(dump_path);
+    dump_path = NULL;
+    enabled = 0;
+}
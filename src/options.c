@@ -0,0 +1,32 @@
+// src/options.c
+#include "options.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *option_names[OPT_COUNT] = {
+    [OPT_PIPEFAIL] = "pipefail",
+    [OPT_ZEROCOPY] = "zerocopy",
+};
+
+static int option_values[OPT_COUNT] = {
+    [OPT_ZEROCOPY] = 1,
+};
+
+int option_enabled(shell_option_t opt) {
+    return opt < OPT_COUNT && option_values[opt];
+}
+
+int option_set(const char *name, int enabled) {
+    for (int i = 0; i < OPT_COUNT; i++) {
+        if (strcmp(name, option_names[i]) == 0) {
+            option_values[i] = enabled;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void options_print(void) {
+    for (int i = 0; i < OPT_COUNT; i++)
+        printf("%-15s %s\n", option_names[i], option_values[i] ? "on" : "off");
+}
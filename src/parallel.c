@@ -0,0 +1,511 @@
+// src/parallel.c
+#define _GNU_SOURCE
+#include "parallel.h"
+#include "cmdhash.h"
+#include "datapump.h"
+#include "jobs.h"
+#include "spawner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/pidfd.h>
+
+// Jobs in flight (running, or done but not yet written) per worker. With
+// ordered output a slow job holds back the ones after it; this bounds how
+// much finished output waits in memory meanwhile.
+#define WINDOW_PER_WORKER 4
+
+// Longest sleep before looking at Ctrl-C again; children without a pidfd
+// are polled more often
+#define WAIT_MS 100
+#define WAIT_NO_PIDFD_MS 10
+
+#define MAX_FAILED 101
+#define INPUT_CHUNK 4096
+
+struct parallel {
+    char **words;                 // Command template, owned copies
+    int nwords;
+    int replace;                  // Some word contains {}
+    char *path;                   // Resolved command, NULL if it varies per item
+    char **items;                 // Items after :::, NULL to read input lines
+    int nitems;
+    int workers;
+    int ordered;
+};
+
+typedef enum {
+    SLOT_FREE,
+    SLOT_RUNNING,
+    SLOT_DONE                     // Finished, output not written yet
+} slot_state_t;
+
+// One job in flight
+typedef struct slot {
+    slot_state_t state;
+    pid_t pid;
+    int pidfd;                    // -1 if pidfd_open is not available
+    int out;                      // memfds collecting its stdout/stderr
+    int err;
+    int status;
+} slot_t;
+
+// Line reader over the input fd that never blocks once poll said readable
+typedef struct input {
+    int fd;
+    char *buf;
+    size_t start;                 // First unread byte
+    size_t len;
+    size_t cap;
+    int eof;
+} input_t;
+
+static void free_words(char **words, int count) {
+    if (!words) return;
+    for (int i = 0; i < count; i++) free(words[i]);
+    free(words);
+}
+
+static char **copy_words(char **src, int count) {
+    char **words = calloc((size_t)count + 1, sizeof(char *));
+    if (!words) return NULL;
+    for (int i = 0; i < count; i++) {
+        if (!(words[i] = strdup(src[i]))) {
+            free_words(words, i);
+            return NULL;
+        }
+    }
+    return words;
+}
+
+void parallel_free(parallel_t *p) {
+    if (!p) return;
+    free_words(p->words, p->nwords);
+    free_words(p->items, p->nitems);
+    free(p->path);
+    free(p);
+}
+
+static parallel_t *usage(parallel_t *p, int err_fd, int *status) {
+    dprintf(err_fd, "usage: parallel [-j N] [-k|-u] command [arg...] [::: item...]\n");
+    parallel_free(p);
+    *status = 2;
+    return NULL;
+}
+
+parallel_t *parallel_prepare(int argc, char **argv, int err_fd, int *status) {
+    parallel_t *p = calloc(1, sizeof(parallel_t));
+    if (!p) {
+        dprintf(err_fd, "parallel: %s\n", strerror(errno));
+        *status = 1;
+        return NULL;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    p->workers = cpus > 0 ? (int)cpus : 1;
+    p->ordered = 1;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(arg, "-k") == 0) {
+            p->ordered = 1;
+        } else if (strcmp(arg, "-u") == 0) {
+            p->ordered = 0;
+        } else if (strncmp(arg, "-j", 2) == 0) {
+            // -j N or -jN
+            const char *num = arg[2] ? arg + 2 : (i + 1 < argc ? argv[++i] : NULL);
+            char *end;
+            long n = num ? strtol(num, &end, 10) : 0;
+            if (!num || *end || n < 1 || n > 4096) return usage(p, err_fd, status);
+            p->workers = (int)n;
+        } else {
+            return usage(p, err_fd, status);
+        }
+    }
+
+    int sep = i;
+    while (sep < argc && strcmp(argv[sep], ":::") != 0) sep++;
+    if (sep == i) return usage(p, err_fd, status);
+
+    p->nwords = sep - i;
+    if (!(p->words = copy_words(argv + i, p->nwords))) goto nomem;
+    if (sep < argc) {
+        p->nitems = argc - sep - 1;
+        if (!(p->items = copy_words(argv + sep + 1, p->nitems))) goto nomem;
+    }
+    for (int w = 0; w < p->nwords; w++) {
+        if (strstr(p->words[w], "{}")) p->replace = 1;
+    }
+
+    // Resolve a fixed command once, here on the shell's thread
+    const char *name = p->words[0];
+    if (!strstr(name, "{}")) {
+        const char *path = strchr(name, '/') ? name : cmdhash_lookup(name);
+        if (!path) {
+            dprintf(err_fd, "parallel: %s: command not found\n", name);
+            parallel_free(p);
+            *status = 127;
+            return NULL;
+        }
+        if (!(p->path = strdup(path))) goto nomem;
+    }
+    return p;
+
+nomem:
+    dprintf(err_fd, "parallel: %s\n", strerror(ENOMEM));
+    parallel_free(p);
+    *status = 1;
+    return NULL;
+}
+
+// The template with every {} replaced by item, or item appended
+static char **build_argv(const parallel_t *p, const char *item) {
+    int argc = p->nwords + !p->replace;
+    char **argv = calloc((size_t)argc + 1, sizeof(char *));
+    if (!argv) return NULL;
+
+    size_t item_len = strlen(item);
+    for (int w = 0; w < p->nwords; w++) {
+        const char *word = p->words[w];
+        size_t count = 0;
+        for (const char *s = word; (s = strstr(s, "{}")); s += 2) count++;
+
+        char *out = malloc(strlen(word) + count * item_len + 1);
+        if (!out) {
+            free_words(argv, w);
+            return NULL;
+        }
+        argv[w] = out;
+        for (const char *s = word; *s;) {
+            if (s[0] == '{' && s[1] == '}') {
+                memcpy(out, item, item_len);
+                out += item_len;
+                s += 2;
+            } else {
+                *out++ = *s++;
+            }
+        }
+        *out = '\0';
+    }
+    if (!p->replace && !(argv[p->nwords] = strdup(item))) {
+        free_words(argv, p->nwords);
+        return NULL;
+    }
+    return argv;
+}
+
+// Launch the job for item in slot s. A job that cannot start is done at
+// once, with its error in its own stderr so it comes out in order.
+// *pgid is the process group workers join (0: none), cleared once it is
+// gone: the shell's job has no process left in it.
+static void start_job(const parallel_t *p, slot_t *s, const char *item, int null_fd, int err_fd,
+                      int detached, pid_t *pgid) {
+    memset(s, 0, sizeof(*s));
+    s->pidfd = -1;
+    s->state = SLOT_DONE;
+    s->status = 1;
+    s->out = memfd_create("parallel-out", MFD_CLOEXEC);
+    s->err = memfd_create("parallel-err", MFD_CLOEXEC);
+    if (s->out == -1 || s->err == -1) {
+        int err = errno;
+        if (s->out != -1) close(s->out);
+        if (s->err != -1) close(s->err);
+        s->out = s->err = -1;
+        dprintf(err_fd, "parallel: memfd_create: %s\n", strerror(err));
+        return;
+    }
+
+    char **argv = build_argv(p, item);
+    if (!argv) {
+        dprintf(s->err, "parallel: %s\n", strerror(ENOMEM));
+        return;
+    }
+
+    spawn_req_t req = {
+        .path = p->path,
+        .argv = argv,
+        .stdin_fd = null_fd,
+        .stdout_fd = s->out,
+        .stderr_fd = s->err,
+        .setpgroup = *pgid > 0 || (detached && jobs_control_enabled()),
+        .pgid = *pgid,
+    };
+    // A command built from the item is looked up by the spawner, as the
+    // command hash belongs to the shell's thread
+    if (!req.path && strchr(argv[0], '/')) req.path = argv[0];
+
+    int err = spawn_process(&req, &s->pid);
+    if (err == EPERM && *pgid > 0) {
+        // The terminal still points at the empty group; Ctrl-C must reach
+        // the shell (and the workers, in its group) instead
+        *pgid = 0;
+        if (!detached) jobs_reclaim_terminal();
+        req.setpgroup = detached && jobs_control_enabled();
+        req.pgid = 0;
+        err = spawn_process(&req, &s->pid);
+    }
+    if (err == 0) {
+        s->state = SLOT_RUNNING;
+        s->pidfd = pidfd_open(s->pid, 0);
+    } else {
+        dprintf(s->err, "parallel: %s: %s\n", argv[0], strerror(err));
+        s->status = (err == ENOENT) ? 127 : 126;
+    }
+    free_words(argv, p->nwords + !p->replace);
+}
+
+// Collect a running job's exit status if it finished (or wait for it)
+static int reap_job(slot_t *s, int block) {
+    siginfo_t info;
+    info.si_pid = 0;
+    int flags = WEXITED | (block ? 0 : WNOHANG);
+    int r = s->pidfd != -1 ? waitid(P_PIDFD, (id_t)s->pidfd, &info, flags)
+                           : waitid(P_PID, (id_t)s->pid, &info, flags);
+    if (r == -1 && errno == EINTR) return 0;
+    if (r == 0 && info.si_pid == 0) return 0;
+
+    s->status = r == -1 ? 1 : (info.si_code == CLD_EXITED ? info.si_status : 128 + info.si_status);
+    s->state = SLOT_DONE;
+    if (s->pidfd != -1) close(s->pidfd);
+    s->pidfd = -1;
+    return 1;
+}
+
+static void release_slot(slot_t *s) {
+    if (s->out != -1) close(s->out);
+    if (s->err != -1) close(s->err);
+    s->out = s->err = -1;
+    s->state = SLOT_FREE;
+}
+
+// Copy a collected stream to fd; empty ones cost one lseek
+static int flush_stream(int memfd, int fd) {
+    if (memfd == -1) return 0;
+    off_t size = lseek(memfd, 0, SEEK_END);
+    if (size <= 0) return 0;
+    lseek(memfd, 0, SEEK_SET);
+    return datapump_copy(memfd, fd);
+}
+
+// Write a finished job's output. Returns -1 with errno set when the output
+// is gone (EPIPE) or Ctrl-C arrived (EINTR).
+static int emit_job(slot_t *s, int out_fd, int err_fd) {
+    int ret = flush_stream(s->out, out_fd);
+    if (ret == 0) ret = flush_stream(s->err, err_fd);
+    int err = errno;
+    release_slot(s);
+    errno = err;
+    return ret;
+}
+
+// Next complete line of input, NUL-terminated in place, or NULL
+static char *next_line(input_t *in) {
+    char *line = in->buf + in->start;
+    char *nl = in->len > in->start ? memchr(line, '\n', in->len - in->start) : NULL;
+    if (nl) {
+        *nl = '\0';
+        in->start = (size_t)(nl - in->buf) + 1;
+        return line;
+    }
+    // An unterminated last line still counts
+    if (in->eof && in->start < in->len) {
+        in->buf[in->len] = '\0';
+        in->start = in->len;
+        return line;
+    }
+    return NULL;
+}
+
+// One read into the buffer, keeping room for a closing NUL
+static void fill_input(input_t *in, int err_fd) {
+    if (in->start > 0) {
+        memmove(in->buf, in->buf + in->start, in->len - in->start);
+        in->len -= in->start;
+        in->start = 0;
+    }
+    if (in->cap - in->len < INPUT_CHUNK + 1) {
+        size_t cap = in->cap ? in->cap * 2 : INPUT_CHUNK * 4;
+        char *buf = realloc(in->buf, cap);
+        if (!buf) {
+            dprintf(err_fd, "parallel: %s\n", strerror(ENOMEM));
+            in->eof = 1;
+            return;
+        }
+        in->buf = buf;
+        in->cap = cap;
+    }
+
+    ssize_t n = read(in->fd, in->buf + in->len, in->cap - in->len - 1);
+    if (n > 0) {
+        in->len += (size_t)n;
+    } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+        if (n == -1) dprintf(err_fd, "parallel: read: %s\n", strerror(errno));
+        in->eof = 1;
+    }
+}
+
+// Stop every running job and reap it
+static void kill_jobs(slot_t *slots, size_t count, int sig) {
+    for (size_t i = 0; i < count; i++) {
+        if (slots[i].state != SLOT_RUNNING) continue;
+        kill(slots[i].pid, sig);
+        // A job stopped with Ctrl-Z gets the signal once continued
+        kill(slots[i].pid, SIGCONT);
+    }
+    for (size_t i = 0; i < count; i++) {
+        while (slots[i].state == SLOT_RUNNING && !reap_job(&slots[i], 1)) continue;
+        release_slot(&slots[i]);
+    }
+}
+
+int parallel_run(parallel_t *p, int in_fd, int out_fd, int err_fd, int detached, pid_t pgid) {
+    if (detached) datapump_detach();
+    if (!jobs_control_enabled()) pgid = 0;
+
+    // Unordered output is written as soon as a job finishes, so a slot per
+    // worker is enough
+    size_t window = (size_t)p->workers * (p->ordered ? WINDOW_PER_WORKER : 1);
+    size_t workers = (size_t)p->workers;
+    slot_t *slots = calloc(window, sizeof(slot_t));
+    struct pollfd *fds = malloc((window + 1) * sizeof(struct pollfd));
+    slot_t **polled = malloc(window * sizeof(slot_t *));
+    int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    input_t input = { .fd = in_fd };
+
+    int status = 1;
+    if (!slots || !fds || !polled || null_fd == -1) {
+        dprintf(err_fd, "parallel: %s\n", strerror(errno));
+        goto out;
+    }
+    for (size_t i = 0; i < window; i++) slots[i].out = slots[i].err = -1;
+
+    size_t head = 0;              // Oldest job in flight (ordered output)
+    size_t next = 0;              // Jobs started so far
+    size_t in_flight = 0;
+    size_t running = 0;
+    int item_index = 0;
+    int failed = 0;
+    status = -1;
+
+    for (;;) {
+        if (datapump_interrupted()) {
+            status = 128 + SIGINT;
+            break;
+        }
+
+        // Feed idle workers
+        while (running < workers && in_flight < window) {
+            const char *item = p->items ? (item_index < p->nitems ? p->items[item_index++] : NULL)
+                                        : next_line(&input);
+            if (!item) break;
+
+            slot_t *s = &slots[next % window];
+            if (!p->ordered) {
+                for (size_t i = 0; i < window; i++) {
+                    if (slots[i].state == SLOT_FREE) {
+                        s = &slots[i];
+                        break;
+                    }
+                }
+            }
+            start_job(p, s, item, null_fd, err_fd, detached, &pgid);
+            if (s->state == SLOT_RUNNING) running++;
+            in_flight++;
+            next++;
+        }
+
+        // Write what is ready: the oldest jobs in order, or any finished one
+        for (size_t i = 0; i < window && status == -1; i++) {
+            slot_t *s = p->ordered ? &slots[head % window] : &slots[i];
+            if (s->state != SLOT_DONE) {
+                if (p->ordered) break;
+                continue;
+            }
+            // Ctrl-C at the terminal went to the job's group: stop all
+            if (s->status == 128 + SIGINT) {
+                status = 128 + SIGINT;
+                break;
+            }
+            if (s->status != 0) failed++;
+            if (emit_job(s, out_fd, err_fd) == -1) {
+                int err = errno;
+                if (err == EPIPE || err == EINTR) {
+                    status = 128 + (err == EPIPE ? SIGPIPE : SIGINT);
+                } else {
+                    dprintf(err_fd, "parallel: %s\n", strerror(err));
+                    status = 1;
+                }
+            }
+            in_flight--;
+            head++;
+        }
+        if (status != -1) break;
+
+        int more = p->items ? item_index < p->nitems : !input.eof || input.start < input.len;
+        if (in_flight == 0 && !more) break;
+
+        // Sleep until a job ends or more input arrives
+        nfds_t nfds = 0;
+        int timeout = WAIT_MS;
+        for (size_t i = 0; i < window; i++) {
+            if (slots[i].state != SLOT_RUNNING) continue;
+            if (slots[i].pidfd == -1) {
+                timeout = WAIT_NO_PIDFD_MS;
+                continue;
+            }
+            fds[nfds].fd = slots[i].pidfd;
+            fds[nfds].events = POLLIN;
+            polled[nfds++] = &slots[i];
+        }
+        int want_input = !p->items && !input.eof && running < workers && in_flight < window;
+        if (want_input) {
+            fds[nfds].fd = in_fd;
+            fds[nfds++].events = POLLIN;
+        }
+
+        if (poll(fds, nfds, timeout) == -1 && errno != EINTR) {
+            dprintf(err_fd, "parallel: poll: %s\n", strerror(errno));
+            status = 1;
+            break;
+        }
+        for (nfds_t k = 0; k < nfds; k++) {
+            if (!fds[k].revents) continue;
+            if (want_input && k == nfds - 1) {
+                fill_input(&input, err_fd);
+            } else if (reap_job(polled[k], 0)) {
+                running--;
+            }
+        }
+        if (timeout == WAIT_NO_PIDFD_MS) {
+            for (size_t i = 0; i < window; i++) {
+                if (slots[i].state == SLOT_RUNNING && slots[i].pidfd == -1 && reap_job(&slots[i], 0))
+                    running--;
+            }
+        }
+    }
+
+    if (status == -1)
+        status = failed > MAX_FAILED ? MAX_FAILED : failed;
+    else
+        kill_jobs(slots, window, status == 128 + SIGINT ? SIGINT : SIGTERM);
+    for (size_t i = 0; i < window; i++) release_slot(&slots[i]);
+
+out:
+    if (null_fd != -1) close(null_fd);
+    free(input.buf);
+    free(polled);
+    free(fds);
+    free(slots);
+    parallel_free(p);
+    return status;
+}
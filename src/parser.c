@@ -4,168 +4,402 @@
 #include <string.h>
 #include <ctype.h>
 #include "parser.h"
-#include "utils.h"
 
-#define MAX_ARGS 64
-#define MAX_COMMANDS 64
+#define ARGV_INITIAL 8
+#define COMMANDS_INITIAL 4
+#define PIPELINES_INITIAL 4
 
+// Every allocation of a command_list_t (including the list itself) comes
+// from one per-line arena, so parsing a typical line is a single malloc
+// and command_list_free releases it all at once.
+//
+// The line is lexed in a single pass. Words are unquoted straight into one
+// arena buffer; since quotes and escapes only ever remove characters, it
+// needs at most one byte per input byte plus a NUL per word.
 
+typedef struct lexer {
+    const char *src;              // Input line
+    size_t pos;                   // Current position in src
+    char *out;                    // Next free byte of the word buffer
+    arena_t *arena;
+} lexer_t;
 
-// Parse a simple command (no pipes)
-static command_t *parse_simple_command(const char *cmdstr) {
-    if (!cmdstr) return NULL;
+typedef enum {
+    TOK_END,                      // End of input
+    TOK_WORD,
+    TOK_PIPE,                     // |
+    TOK_PIPE_ERR,                 // |&
+    TOK_IN,                       // <
+    TOK_OUT,                      // >
+    TOK_APPEND,                   // >>
+    TOK_ERR_OUT,                  // 2>
+    TOK_ERR_APPEND,               // 2>>
+    TOK_ERR_TO_OUT,               // 2>&1
+    TOK_ALL_OUT,                  // &>
+    TOK_ALL_APPEND,               // &>>
+    TOK_AMP,                      // & (run in background)
+    TOK_AND_IF,                   // &&
+    TOK_OR_IF,                    // ||
+    TOK_SEMI,                     // ;
+    TOK_ERROR                     // Unterminated quote
+} token_t;
 
-    command_t *cmd = calloc(1, sizeof(command_t));
-    if (!cmd) return NULL;
+static inline int is_word_end(const char *p) {
+    return *p == '\0' || isspace((unsigned char)*p) || *p == '|' || *p == '<' || *p == '>' ||
+           *p == '&' || *p == ';';
+}
 
-    cmd->raw = strdup(cmdstr);
-    if (!cmd->raw) {
-        free(cmd);
-        return NULL;
-    }
+// Unquote the word at lx->pos into the word buffer
+static token_t lex_word(lexer_t *lx, char **word) {
+    const char *s = lx->src;
+    size_t pos = lx->pos;
+    char *out = lx->out;
+    *word = out;
 
-    char *copy = strdup(cmdstr);
-    if (!copy) {
-        free(cmd->raw);
-        free(cmd);
-        return NULL;
+    while (!is_word_end(s + pos)) {
+        char c = s[pos];
+        if (c == '\\') {
+            // A trailing backslash stays literal
+            if (s[pos + 1]) pos++;
+            *out++ = s[pos++];
+        } else if (c == '\'') {
+            pos++;
+            while (s[pos] && s[pos] != '\'') *out++ = s[pos++];
+            if (!s[pos]) return TOK_ERROR;
+            pos++;
+        } else if (c == '"') {
+            pos++;
+            while (s[pos] && s[pos] != '"') {
+                if (s[pos] == '\\' && s[pos + 1] && strchr("\\\"$`", s[pos + 1])) pos++;
+                *out++ = s[pos++];
+            }
+            if (!s[pos]) return TOK_ERROR;
+            pos++;
+        } else {
+            *out++ = s[pos++];
+        }
     }
+    *out++ = '\0';
+    lx->out = out;
+    lx->pos = pos;
+    return TOK_WORD;
+}
 
-    cmd->argv = calloc(MAX_ARGS, sizeof(char *));
-    if (!cmd->argv) {
-        free(copy);
-        free(cmd->raw);
-        free(cmd);
-        return NULL;
+// Next token; *word is set for TOK_WORD
+static token_t lex_next(lexer_t *lx, char **word) {
+    const char *s = lx->src;
+    while (isspace((unsigned char)s[lx->pos])) lx->pos++;
+
+    const char *p = s + lx->pos;
+    switch (p[0]) {
+        case '\0':
+            return TOK_END;
+        case '|':
+            if (p[1] == '&') {
+                lx->pos += 2;
+                return TOK_PIPE_ERR;
+            }
+            if (p[1] == '|') {
+                lx->pos += 2;
+                return TOK_OR_IF;
+            }
+            lx->pos++;
+            return TOK_PIPE;
+        case '<':
+            lx->pos++;
+            return TOK_IN;
+        case '>':
+            if (p[1] == '>') {
+                lx->pos += 2;
+                return TOK_APPEND;
+            }
+            lx->pos++;
+            return TOK_OUT;
+        case '&':
+            if (p[1] == '>') {
+                if (p[2] == '>') {
+                    lx->pos += 3;
+                    return TOK_ALL_APPEND;
+                }
+                lx->pos += 2;
+                return TOK_ALL_OUT;
+            }
+            if (p[1] == '&') {
+                lx->pos += 2;
+                return TOK_AND_IF;
+            }
+            lx->pos++;
+            return TOK_AMP;
+        case ';':
+            lx->pos++;
+            return TOK_SEMI;
+        case '2':
+            // Only a word that is exactly "2" directly before '>' is a fd
+            if (p[1] == '>') {
+                if (p[2] == '&' && p[3] == '1' && is_word_end(p + 4)) {
+                    lx->pos += 4;
+                    return TOK_ERR_TO_OUT;
+                }
+                if (p[2] == '>') {
+                    lx->pos += 3;
+                    return TOK_ERR_APPEND;
+                }
+                lx->pos += 2;
+                return TOK_ERR_OUT;
+            }
+            break;
     }
+    return lex_word(lx, word);
+}
 
-    char *token;
-    char *saveptr;
-    int argc = 0;
-
-    token = strtok_r(copy, " \t", &saveptr);
-    while (token != NULL && argc < MAX_ARGS - 1) {
-        if (strcmp(token, "<") == 0) {
-            token = strtok_r(NULL, " \t", &saveptr);
-            if (!token) goto fail;
-            cmd->input_file = strdup(token);
-            if (!cmd->input_file) goto fail;
-        } else if (strcmp(token, ">>") == 0) {
-            token = strtok_r(NULL, " \t", &saveptr);
-            if (!token) goto fail;
-            cmd->output_file = strdup(token);
-            if (!cmd->output_file) goto fail;
-            cmd->append_output = 1;
-        } else if (strcmp(token, ">") == 0) {
-            token = strtok_r(NULL, " \t", &saveptr);
-            if (!token) goto fail;
-            cmd->output_file = strdup(token);
-            if (!cmd->output_file) goto fail;
-            cmd->append_output = 0;
-        } else {
-            cmd->argv[argc] = strdup(token);
-            if (!cmd->argv[argc]) goto fail;
-            argc++;
+// Double a full vector held in the arena; the old copy is simply abandoned
+static void *vec_grow(arena_t *arena, void *vec, size_t count, size_t *cap, size_t elem) {
+    size_t new_cap = *cap * 2;
+    void *tmp = arena_alloc(arena, new_cap * elem);
+    if (!tmp) return NULL;
+    memcpy(tmp, vec, count * elem);
+    *cap = new_cap;
+    return tmp;
+}
+
+// Parse one pipeline stage up to the next pipe, list operator or the end of
+// input. *sep receives the token that ended it.
+static command_t *parse_simple_command(lexer_t *lx, token_t *sep) {
+    arena_t *arena = lx->arena;
+
+    command_t *cmd = arena_calloc(arena, 1, sizeof(command_t));
+    if (!cmd) return NULL;
+
+    size_t argc = 0, cap = ARGV_INITIAL;
+    size_t outs_cap = 0;
+    char **argv = arena_alloc(arena, cap * sizeof(char *));
+    if (!argv) return NULL;
+
+    while (isspace((unsigned char)lx->src[lx->pos])) lx->pos++;
+    size_t start = lx->pos;
+    size_t end = start;
+
+    for (;;) {
+        char *word = NULL;
+        token_t tok = lex_next(lx, &word);
+
+        if (tok == TOK_END || tok == TOK_PIPE || tok == TOK_PIPE_ERR || tok == TOK_AMP ||
+            tok == TOK_AND_IF || tok == TOK_OR_IF || tok == TOK_SEMI) {
+            *sep = tok;
+            break;
+        }
+        if (tok == TOK_ERROR) return NULL;
+        end = lx->pos;
+
+        if (tok == TOK_WORD) {
+            // Keep a free slot for the terminating NULL
+            if (argc + 1 == cap && !(argv = vec_grow(arena, argv, argc, &cap, sizeof(char *))))
+                return NULL;
+            argv[argc++] = word;
+            continue;
+        }
+        if (tok == TOK_ERR_TO_OUT) {
+            cmd->error_file = NULL;
+            cmd->stderr_to_stdout = 1;
+            cmd->stderr_before_out = !cmd->output_file;
+            continue;
+        }
+
+        // Every other operator takes a file name
+        char *file = NULL;
+        if (lex_next(lx, &file) != TOK_WORD) return NULL;
+        end = lx->pos;
+
+        switch (tok) {
+            case TOK_IN:
+                cmd->input_file = file;
+                break;
+            case TOK_OUT:
+            case TOK_APPEND:
+                if (cmd->output_file) {
+                    // Every further target also receives stdout
+                    size_t n = (size_t)cmd->more_output_count;
+                    if (n == outs_cap) {
+                        output_redir_t *outs = outs_cap
+                            ? vec_grow(arena, cmd->more_outputs, n, &outs_cap, sizeof(output_redir_t))
+                            : arena_alloc(arena, (outs_cap = 2) * sizeof(output_redir_t));
+                        if (!outs) return NULL;
+                        cmd->more_outputs = outs;
+                    }
+                    cmd->more_outputs[n].file = file;
+                    cmd->more_outputs[n].append = (tok == TOK_APPEND);
+                    cmd->more_output_count++;
+                    break;
+                }
+                cmd->output_file = file;
+                cmd->append_output = (tok == TOK_APPEND);
+                break;
+            case TOK_ERR_OUT:
+            case TOK_ERR_APPEND:
+                cmd->error_file = file;
+                cmd->append_error = (tok == TOK_ERR_APPEND);
+                cmd->stderr_to_stdout = 0;
+                cmd->stderr_before_out = 0;
+                break;
+            case TOK_ALL_OUT:
+            case TOK_ALL_APPEND:
+                cmd->output_file = file;
+                cmd->append_output = (tok == TOK_ALL_APPEND);
+                cmd->error_file = NULL;
+                cmd->stderr_to_stdout = 1;
+                cmd->stderr_before_out = 0;
+                break;
+            default:
+                break;
         }
-        token = strtok_r(NULL, " \t", &saveptr);
     }
-    cmd->argv[argc] = NULL;
-    cmd->argc = argc;
 
-    free(copy);
+    argv[argc] = NULL;
+    cmd->argv = argv;
+    cmd->argc = (int)argc;
+    cmd->pipe_stderr = (*sep == TOK_PIPE_ERR);
+
+    cmd->raw = arena_strndup(arena, lx->src + start, end - start);
+    if (!cmd->raw) return NULL;
+
     return cmd;
+}
 
-fail:
-    for (int i = 0; i < argc; i++) {
-        free(cmd->argv[i]);
+// Parse stages joined by | and |& up to a list operator or the end of input;
+// *sep receives the token that ended the pipeline
+static pipeline_t *parse_pipeline(lexer_t *lx, token_t *sep) {
+    arena_t *arena = lx->arena;
+    pipeline_t *p = arena_calloc(arena, 1, sizeof(pipeline_t));
+    if (!p) return NULL;
+
+    size_t cap = COMMANDS_INITIAL;
+    p->commands = arena_alloc(arena, cap * sizeof(command_t *));
+    if (!p->commands) return NULL;
+
+    do {
+        command_t *cmd = parse_simple_command(lx, sep);
+        if (!cmd) return NULL;
+
+        // A pipe or list operator needs a command on both sides
+        if (cmd->argc == 0 && !cmd->input_file && !cmd->output_file && !cmd->error_file)
+            return NULL;
+
+        if (p->count == cap && !(p->commands = vec_grow(arena, p->commands, p->count, &cap, sizeof(command_t *))))
+            return NULL;
+        p->commands[p->count++] = cmd;
+    } while (*sep == TOK_PIPE || *sep == TOK_PIPE_ERR);
+
+    for (size_t i = 0; i + 1 < p->count; i++) {
+        p->commands[i]->pipe_to = p->commands[i + 1];
+        p->commands[i]->pipe_count = 1;
     }
-    free(cmd->argv);
-    free(cmd->input_file);
-    free(cmd->output_file);
-    free(cmd->raw);
-    free(cmd);
-    free(copy);
-    return NULL;
+    p->commands[p->count - 1]->pipe_to = NULL;
+    return p;
+}
+
+static node_t *new_node(arena_t *arena, node_kind_t kind, node_t *left, node_t *right) {
+    node_t *node = arena_calloc(arena, 1, sizeof(node_t));
+    if (!node) return NULL;
+    node->kind = kind;
+    node->left = left;
+    node->right = right;
+    return node;
 }
 
+// Why the last parse_input() failed, when it can tell
+static const char *error_reason = NULL;
+
+const char *parse_error(void) {
+    return error_reason;
+}
+
+// Parse a pipeline into a leaf, recording it in the list's pipelines
+static node_t *parse_leaf(command_list_t *cmdlist, lexer_t *lx, token_t *sep, size_t *cap) {
+    arena_t *arena = &cmdlist->arena;
+    pipeline_t *p = parse_pipeline(lx, sep);
+    if (!p) return NULL;
+
+    if (cmdlist->pipeline_count == *cap &&
+        !(cmdlist->pipelines = vec_grow(arena, cmdlist->pipelines, cmdlist->pipeline_count, cap,
+                                        sizeof(pipeline_t *))))
+        return NULL;
+    cmdlist->pipelines[cmdlist->pipeline_count++] = p;
+
+    node_t *leaf = new_node(arena, NODE_PIPELINE, NULL, NULL);
+    if (leaf) leaf->pipeline = p;
+    return leaf;
+}
+
+// The grammar, loosest binding first:
+//   list     := and_or ((';' | '&') and_or)* [';' | '&']
+//   and_or   := pipeline (('&&' | '||') pipeline)*
+//   pipeline := command (('|' | '|&') command)*
+// && and || bind left to right with equal precedence, as in sh.
 command_list_t *parse_input(const char *input) {
+    error_reason = NULL;
     if (!input) return NULL;
 
-    command_list_t *cmdlist = calloc(1, sizeof(command_list_t));
-    if (!cmdlist) return NULL;
+    size_t len = strlen(input);
+    arena_t arena;
+    arena_init(&arena, sizeof(command_list_t) + 4 * len + 512);
 
-    char *input_copy = strdup(input);
-    if (!input_copy) {
-        free(cmdlist);
+    command_list_t *cmdlist = arena_calloc(&arena, 1, sizeof(command_list_t));
+    if (!cmdlist) {
+        arena_release(&arena);
         return NULL;
     }
+    // From here on the list owns the arena
+    cmdlist->arena = arena;
+    arena_t *a = &cmdlist->arena;
 
-    char *saveptr = NULL;
-    char *token = strtok_r(input_copy, "|", &saveptr);
+    lexer_t lx = { .src = input, .pos = 0, .arena = a };
+    lx.out = arena_alloc(a, 2 * len + 2);
+    if (!lx.out) goto fail;
 
-    command_t **commands = calloc(MAX_COMMANDS, sizeof(command_t *));
-    if (!commands) {
-        free(input_copy);
-        free(cmdlist);
-        return NULL;
-    }
+    size_t cap = PIPELINES_INITIAL;
+    cmdlist->pipelines = arena_alloc(a, cap * sizeof(pipeline_t *));
+    if (!cmdlist->pipelines) goto fail;
 
-    size_t count = 0;
+    // An empty line parses to an empty list
+    for (;;) {
+        while (isspace((unsigned char)input[lx.pos])) lx.pos++;
+        if (!input[lx.pos]) break;
 
-    while (token != NULL && count < MAX_COMMANDS) {
-        char *trimmed = trim_whitespace(token);
-        if (!trimmed) trimmed = token;
+        token_t sep;
+        node_t *and_or = parse_leaf(cmdlist, &lx, &sep, &cap);
+        if (!and_or) goto fail;
+        while (sep == TOK_AND_IF || sep == TOK_OR_IF) {
+            node_kind_t kind = (sep == TOK_AND_IF) ? NODE_AND : NODE_OR;
+            node_t *right = parse_leaf(cmdlist, &lx, &sep, &cap);
+            if (!right || !(and_or = new_node(a, kind, and_or, right))) goto fail;
+        }
 
-        command_t *cmd = parse_simple_command(trimmed);
-        if (!cmd) {
-            for (size_t i = 0; i < count; i++) {
-                command_free(commands[i]);
+        // & backgrounds a single pipeline; an && / || chain would need a
+        // subshell to run in the background
+        if (sep == TOK_AMP) {
+            if (and_or->kind != NODE_PIPELINE) {
+                error_reason = "cannot run an && or || list in the background";
+                goto fail;
             }
-            free(commands);
-            free(input_copy);
-            free(cmdlist);
-            return NULL;
+            and_or->pipeline->background = 1;
         }
-        commands[count++] = cmd;
-        token = strtok_r(NULL, "|", &saveptr);
-    }
 
-    for (size_t i = 0; i + 1 < count; i++) {
-        commands[i]->pipe_to = commands[i + 1];
-        commands[i]->pipe_count = 1;
+        if (cmdlist->root && !(and_or = new_node(a, NODE_SEQ, cmdlist->root, and_or))) goto fail;
+        cmdlist->root = and_or;
+        if (sep == TOK_END) break;
     }
-    if (count > 0) commands[count - 1]->pipe_to = NULL;
 
-    cmdlist->commands = commands;
-    cmdlist->count = count;
-
-    free(input_copy);
     return cmdlist;
-}
 
-void command_free(command_t *cmd) {
-    if (!cmd) return;
-
-    if (cmd->raw) free(cmd->raw);
-    if (cmd->argv) {
-        for (int i = 0; i < cmd->argc; i++) {
-            free(cmd->argv[i]);
-        }
-        free(cmd->argv);
-    }
-    if (cmd->input_file) free(cmd->input_file);
-    if (cmd->output_file) free(cmd->output_file);
-    free(cmd);
+fail:
+    command_list_free(cmdlist);
+    return NULL;
 }
 
 void command_list_free(command_list_t *cmdlist) {
     if (!cmdlist) return;
 
-    for (size_t i = 0; i < cmdlist->count; i++) {
-        command_free(cmdlist->commands[i]);
-    }
-    free(cmdlist->commands);
-    free(cmdlist);
+    // The list itself lives in the arena, so release from a copy
+    arena_t arena = cmdlist->arena;
+    arena_release(&arena);
 }
-
-
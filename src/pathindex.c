@@ -0,0 +1,278 @@
+// src/pathindex.c
+#define _GNU_SOURCE
+#include "pathindex.h"
+#include "cmdhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                    IN_DELETE_SELF | IN_MOVE_SELF)
+
+// One $PATH directory and the executables found in it
+typedef struct path_dir {
+    char *path;
+    char *names;                  // NUL-separated names
+    size_t names_len, names_cap;
+    size_t count;                 // Number of names
+    struct timespec mtime;        // Directory mtime at last scan
+    int wd;                       // inotify watch descriptor or -1
+    int dirty;                    // Needs rescan
+} path_dir_t;
+
+typedef struct path_index {
+    char *path_env;               // $PATH the index was built from
+    path_dir_t *dirs;
+    size_t dir_count;
+    const char **sorted;          // Unique names across dirs, strcmp order
+    size_t sorted_count;
+    int inotify_fd;               // -1 when falling back to mtime checks
+} path_index_t;
+
+static path_index_t index_state = { .inotify_fd = -1 };
+static pthread_t builder;
+static int builder_running = 0;
+
+static int append_name(path_dir_t *d, const char *name) {
+    size_t len = strlen(name) + 1;
+    if (d->names_len + len > d->names_cap) {
+        size_t cap = d->names_cap ? d->names_cap * 2 : 4096;
+        while (cap < d->names_len + len) cap *= 2;
+        char *tmp = realloc(d->names, cap);
+        if (!tmp) return -1;
+        d->names = tmp;
+        d->names_cap = cap;
+    }
+    memcpy(d->names + d->names_len, name, len);
+    d->names_len += len;
+    d->count++;
+    return 0;
+}
+
+// Read the executables of one directory
+static void scan_dir(path_dir_t *d) {
+    d->names_len = 0;
+    d->count = 0;
+    d->dirty = 0;
+
+    int dfd = open(d->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd == -1) return;
+
+    struct stat st;
+    if (fstat(dfd, &st) == 0) d->mtime = st.st_mtim;
+
+    DIR *dp = fdopendir(dfd);
+    if (!dp) {
+        close(dfd);
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dp)) != NULL) {
+        if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+            continue;
+        if (entry->d_name[0] == '.' &&
+            (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+            continue;
+        if (faccessat(dfd, entry->d_name, X_OK, 0) != 0)
+            continue;
+        if (append_name(d, entry->d_name) != 0)
+            break;
+    }
+    closedir(dp);
+}
+
+static int cmp_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Rebuild the merged, de-duplicated name array from the per-dir lists
+static void merge(path_index_t *ix) {
+    size_t total = 0;
+    for (size_t i = 0; i < ix->dir_count; i++) total += ix->dirs[i].count;
+
+    const char **sorted = realloc(ix->sorted, (total ? total : 1) * sizeof(char *));
+    if (!sorted) return;
+    ix->sorted = sorted;
+
+    size_t n = 0;
+    for (size_t i = 0; i < ix->dir_count; i++) {
+        const char *p = ix->dirs[i].names;
+        for (size_t j = 0; j < ix->dirs[i].count; j++) {
+            sorted[n++] = p;
+            p += strlen(p) + 1;
+        }
+    }
+    qsort(sorted, n, sizeof(char *), cmp_names);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (unique == 0 || strcmp(sorted[unique - 1], sorted[i]) != 0)
+            sorted[unique++] = sorted[i];
+    }
+    ix->sorted_count = unique;
+}
+
+static void index_clear(path_index_t *ix) {
+    if (ix->inotify_fd != -1) close(ix->inotify_fd);
+    for (size_t i = 0; i < ix->dir_count; i++) {
+        free(ix->dirs[i].path);
+        free(ix->dirs[i].names);
+    }
+    free(ix->dirs);
+    free(ix->sorted);
+    free(ix->path_env);
+    memset(ix, 0, sizeof(*ix));
+    ix->inotify_fd = -1;
+}
+
+static void index_build(path_index_t *ix) {
+    const char *path_env = getenv("PATH");
+    if (!path_env) path_env = CMDHASH_DEFAULT_PATH;
+
+    ix->path_env = strdup(path_env);
+    if (!ix->path_env) return;
+    ix->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    size_t cap = 1;
+    for (const char *p = path_env; *p; p++)
+        if (*p == ':') cap++;
+    ix->dirs = calloc(cap, sizeof(path_dir_t));
+    if (!ix->dirs) return;
+
+    const char *dir = path_env;
+    for (;;) {
+        const char *end = strchrnul(dir, ':');
+        path_dir_t *d = &ix->dirs[ix->dir_count];
+        d->path = dir == end ? strdup(".") : strndup(dir, (size_t)(end - dir));
+        d->wd = -1;
+        if (d->path) {
+            if (ix->inotify_fd != -1)
+                d->wd = inotify_add_watch(ix->inotify_fd, d->path, WATCH_MASK);
+            scan_dir(d);
+            ix->dir_count++;
+        }
+        if (*end == '\0') break;
+        dir = end + 1;
+    }
+    merge(ix);
+}
+
+static void *builder_main(void *arg) {
+    (void)arg;
+    index_build(&index_state);
+    return NULL;
+}
+
+void pathindex_init(void) {
+    if (builder_running || index_state.path_env) return;
+    if (pthread_create(&builder, NULL, builder_main, NULL) == 0)
+        builder_running = 1;
+    else
+        index_build(&index_state);
+}
+
+// Mark directories reported by inotify (or whose mtime moved) as dirty
+static int collect_changes(path_index_t *ix) {
+    int changed = 0;
+
+    if (ix->inotify_fd != -1) {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t n;
+        while ((n = read(ix->inotify_fd, buf, sizeof(buf))) > 0) {
+            for (char *p = buf; p < buf + n;) {
+                struct inotify_event *ev = (struct inotify_event *)p;
+                for (size_t i = 0; i < ix->dir_count; i++) {
+                    if (ix->dirs[i].wd == ev->wd) {
+                        ix->dirs[i].dirty = 1;
+                        changed = 1;
+                    }
+                }
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
+    }
+
+    // Directories without a watch fall back to an mtime check
+    for (size_t i = 0; i < ix->dir_count; i++) {
+        path_dir_t *d = &ix->dirs[i];
+        if (d->wd != -1) continue;
+        struct stat st;
+        if (stat(d->path, &st) != 0) {
+            if (d->count) d->dirty = changed = 1;
+        } else if (st.st_mtim.tv_sec != d->mtime.tv_sec || st.st_mtim.tv_nsec != d->mtime.tv_nsec) {
+            d->dirty = changed = 1;
+        }
+    }
+    return changed;
+}
+
+void pathindex_refresh(void) {
+    path_index_t *ix = &index_state;
+
+    if (builder_running) {
+        pthread_join(builder, NULL);
+        builder_running = 0;
+    }
+
+    const char *path_env = getenv("PATH");
+    if (!path_env) path_env = CMDHASH_DEFAULT_PATH;
+    if (!ix->path_env || strcmp(ix->path_env, path_env) != 0) {
+        index_clear(ix);
+        index_build(ix);
+        return;
+    }
+
+    if (!collect_changes(ix)) return;
+    for (size_t i = 0; i < ix->dir_count; i++) {
+        path_dir_t *d = &ix->dirs[i];
+        if (!d->dirty) continue;
+        // A watched directory that was removed or renamed needs a new watch
+        if (ix->inotify_fd != -1) {
+            if (d->wd != -1) inotify_rm_watch(ix->inotify_fd, d->wd);
+            d->wd = inotify_add_watch(ix->inotify_fd, d->path, WATCH_MASK);
+        }
+        scan_dir(d);
+    }
+    merge(ix);
+}
+
+size_t pathindex_prefix(const char *prefix, const char *const **names) {
+    path_index_t *ix = &index_state;
+    size_t len = strlen(prefix);
+
+    // Lower bound of prefix
+    size_t lo = 0, hi = ix->sorted_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(ix->sorted[mid], prefix) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t first = lo;
+
+    // First name past the prefix run
+    hi = ix->sorted_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strncmp(ix->sorted[mid], prefix, len) == 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    *names = ix->sorted + first;
+    return lo - first;
+}
+
+void pathindex_free(void) {
+    if (builder_running) {
+        pthread_join(builder, NULL);
+        builder_running = 0;
+    }
+    index_clear(&index_state);
+}
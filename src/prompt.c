@@ -6,6 +6,9 @@
 #include <pwd.h>
 #include <limits.h>
 #include "config.h"
+#include "gitstatus.h"
+#include "jobs.h"
+#include "prompt.h"
 
 static const char *color_reset = "\033[0m";
 static const char *color_user_light = "\033[1;32m";    // bright green
@@ -14,78 +17,253 @@ static const char *color_path_light = "\033[1;35m";    // bright magenta
 static const char *color_user_dark = "\033[0;32m";     // green
 static const char *color_host_dark = "\033[0;34m";     // blue
 static const char *color_path_dark = "\033[0;35m";     // magenta
+static const char *color_git_light = "\033[1;33m";     // bright yellow
+static const char *color_git_dark = "\033[0;33m";      // yellow
 
-void prompt_render(char *buf, size_t bufsize, const shell_config_t *config) {
-    if (!buf || !config) return;
+// Longest a prompt waits for the git segment before drawing without it
+#define GIT_BUDGET_MS 20
 
-    char hostname[HOST_NAME_MAX + 1] = {0};
-    gethostname(hostname, sizeof(hostname));
+// The format is compiled into runs of fixed text (user, host, colors and
+// literals already expanded) and the few segments that change between
+// prompts, so drawing a prompt is a handful of memcpy calls.
+typedef enum {
+    SEG_TEXT,                     // text[offset, offset + len)
+    SEG_CWD,                      // Working directory (\w)
+    SEG_STATUS,                   // Exit status of the last command (\?)
+    SEG_JOBS,                     // Number of jobs (\j)
+    SEG_DURATION,                 // Wall time of the last command (\t)
+    SEG_GIT                       // (branch) with * when dirty (\g)
+} segment_kind_t;
 
-    char cwd[PATH_MAX] = {0};
-    if (!getcwd(cwd, sizeof(cwd))) {
-        strcpy(cwd, "unknown");
-    }
+typedef struct segment {
+    segment_kind_t kind;
+    size_t offset;
+    size_t len;
+} segment_t;
+
+#define PROMPT_TEXT_MAX 2048
+
+static char seg_text[PROMPT_TEXT_MAX];
+static size_t seg_text_len = 0;
+static segment_t segments[PROMPT_MAX_LEN + 1];
+static size_t segment_count = 0;
+static const shell_config_t *compiled_for = NULL;
+static const char *git_color = NULL;
+static int has_git = 0;
+
+static int last_status = 0;
+static double last_seconds = 0;
+
+// Looked up once: getpwuid can go through NSS (LDAP, sssd) on every call
+static char user[LOGIN_NAME_MAX + 1];
+static char hostname[HOST_NAME_MAX + 1];
+static int is_root = 0;
+static int identity_loaded = 0;
+
+// Refreshed lazily after cd
+static char cwd[PATH_MAX];
+static size_t cwd_len = 0;
+static int cwd_stale = 1;
 
+static void load_identity(void) {
     struct passwd *pw = getpwuid(getuid());
-    const char *user = pw ? pw->pw_name : "user";
-    const int is_root = (geteuid() == 0);
+    snprintf(user, sizeof(user), "%s", pw ? pw->pw_name : "user");
+    if (gethostname(hostname, sizeof(hostname)) != 0) hostname[0] = '\0';
+    hostname[HOST_NAME_MAX] = '\0';
+    is_root = (geteuid() == 0);
+    identity_loaded = 1;
+}
+
+static void refresh_cwd(void) {
+    if (!getcwd(cwd, sizeof(cwd))) strcpy(cwd, "unknown");
+    cwd_len = strlen(cwd);
+    cwd_stale = 0;
+}
+
+void prompt_invalidate_cwd(void) {
+    cwd_stale = 1;
+}
+
+// Append fixed text, extending the last text segment when possible
+static void add_text(const char *s, size_t len) {
+    if (len > PROMPT_TEXT_MAX - seg_text_len) len = PROMPT_TEXT_MAX - seg_text_len;
+    if (len == 0) return;
+    segment_t *last = segment_count ? &segments[segment_count - 1] : NULL;
+    if (!last || last->kind != SEG_TEXT) {
+        if (segment_count == sizeof(segments) / sizeof(segments[0])) return;
+        last = &segments[segment_count++];
+        last->kind = SEG_TEXT;
+        last->offset = seg_text_len;
+        last->len = 0;
+    }
+    memcpy(seg_text + seg_text_len, s, len);
+    seg_text_len += len;
+    last->len += len;
+}
+
+static void add_colored(const char *color, const char *s) {
+    add_text(color, strlen(color));
+    add_text(s, strlen(s));
+    add_text(color_reset, strlen(color_reset));
+}
+
+static void add_segment(segment_kind_t kind) {
+    if (segment_count == sizeof(segments) / sizeof(segments[0])) return;
+    segments[segment_count++] = (segment_t){ .kind = kind };
+}
+
+void prompt_compile(const shell_config_t *config) {
+    if (!config) return;
+    if (!identity_loaded) load_identity();
 
     const char *c_user = (config->theme == THEME_DARK) ? color_user_dark : color_user_light;
     const char *c_host = (config->theme == THEME_DARK) ? color_host_dark : color_host_light;
     const char *c_path = (config->theme == THEME_DARK) ? color_path_dark : color_path_light;
-    const char *c_reset = color_reset;
 
-    const char *p = config->prompt_format;
+    seg_text_len = 0;
+    segment_count = 0;
+    has_git = 0;
+    git_color = (config->theme == THEME_DARK) ? color_git_dark : color_git_light;
+    for (const char *p = config->prompt_format; *p; p++) {
+        if (*p != '\\') {
+            add_text(p, 1);
+            continue;
+        }
+        switch (*++p) {
+            case 'u':
+                add_colored(c_user, user);
+                break;
+            case 'h':
+                add_colored(c_host, hostname);
+                break;
+            case 'w':
+                add_text(c_path, strlen(c_path));
+                add_segment(SEG_CWD);
+                add_text(color_reset, strlen(color_reset));
+                break;
+            case '$':
+                add_text(is_root ? "#" : "$", 1);
+                break;
+            case '?':
+                add_segment(SEG_STATUS);
+                break;
+            case 'j':
+                add_segment(SEG_JOBS);
+                break;
+            case 't':
+                add_segment(SEG_DURATION);
+                break;
+            case 'g':
+                add_segment(SEG_GIT);
+                has_git = 1;
+                break;
+            case '\\':
+                add_text("\\", 1);
+                break;
+            case '\0':
+                // A trailing backslash is dropped
+                p--;
+                break;
+            default:
+                add_text(p - 1, 2);
+                break;
+        }
+    }
+    compiled_for = config;
+}
+
+// Copy len bytes at dst, truncated to the space left
+static void put(char **dst, size_t *remaining, const char *s, size_t len) {
+    if (len >= *remaining) len = *remaining - 1;
+    memcpy(*dst, s, len);
+    *dst += len;
+    *remaining -= len;
+}
+
+void prompt_command_done(int status, double seconds) {
+    last_status = status;
+    last_seconds = seconds;
+}
+
+// 850ms, 4.2s, 3m07s
+static int format_duration(char *buf, size_t size, double seconds) {
+    if (seconds < 1)
+        return snprintf(buf, size, "%dms", (int)(seconds * 1000));
+    if (seconds < 60)
+        return snprintf(buf, size, "%.1fs", seconds);
+    long whole = (long)seconds;
+    return snprintf(buf, size, "%ldm%02lds", whole / 60, whole % 60);
+}
+
+// fresh: a new prompt, which starts a git lookup; otherwise a repaint with
+// whatever arrived since
+static void render(char *buf, size_t bufsize, const shell_config_t *config, int fresh) {
+    if (!buf || !config || bufsize == 0) return;
+    if (compiled_for != config) prompt_compile(config);
+
+    char git[160] = "";
+    if (has_git) {
+        if (cwd_stale) refresh_cwd();
+        if (fresh) gitstatus_request(cwd);
+        gitstatus_get(git, sizeof(git), fresh ? GIT_BUDGET_MS : 0);
+    }
+
     char *dst = buf;
     size_t remaining = bufsize;
-
-    while (*p && remaining > 1) {
-        if (*p == '\\') {
-            p++;
-            switch (*p) {
-                case 'u': {
-                    int n = snprintf(dst, remaining, "%s%s%s", c_user, user, c_reset);
-                    dst += n;
-                    remaining -= (size_t)n;
-                    break;
-                }
-                case 'h': {
-                    int n = snprintf(dst, remaining, "%s%s%s", c_host, hostname, c_reset);
-                    dst += n;
-                    remaining -= (size_t)n;
-                    break;
-                }
-                case 'w': {
-                    int n = snprintf(dst, remaining, "%s%s%s", c_path, cwd, c_reset);
-                    dst += n;
-                    remaining -= (size_t)n;
-                    break;
+    char num[48];
+    int n;
+    for (size_t i = 0; i < segment_count && remaining > 1; i++) {
+        const segment_t *seg = &segments[i];
+        switch (seg->kind) {
+            case SEG_TEXT:
+                put(&dst, &remaining, seg_text + seg->offset, seg->len);
+                break;
+            case SEG_CWD:
+                if (cwd_stale) refresh_cwd();
+                put(&dst, &remaining, cwd, cwd_len);
+                break;
+            case SEG_STATUS:
+                n = snprintf(num, sizeof(num), "%d", last_status);
+                put(&dst, &remaining, num, (size_t)n);
+                break;
+            case SEG_JOBS:
+                n = snprintf(num, sizeof(num), "%zu", jobs_count());
+                put(&dst, &remaining, num, (size_t)n);
+                break;
+            case SEG_DURATION:
+                n = format_duration(num, sizeof(num), last_seconds);
+                put(&dst, &remaining, num, (size_t)n);
+                break;
+            case SEG_GIT:
+                if (git[0]) {
+                    put(&dst, &remaining, git_color, strlen(git_color));
+                    put(&dst, &remaining, "(", 1);
+                    put(&dst, &remaining, git, strlen(git));
+                    put(&dst, &remaining, ")", 1);
+                    put(&dst, &remaining, color_reset, strlen(color_reset));
                 }
-                case '$': {
-                    int n = snprintf(dst, remaining, "%c", is_root ? '#' : '$');
-                    dst += n;
-                    remaining -= (size_t)n;
-                    break;
-                }
-                case '\\':
-                    if (remaining > 1) {
-                        *dst++ = '\\';
-                        remaining--;
-                    }
-                    break;
-                default:
-                    if (remaining > 2) {
-                        *dst++ = '\\';
-                        *dst++ = *p;
-                        remaining -= 2;
-                    }
-                    break;
-            }
-            p++;
-        } else {
-            *dst++ = *p++;
-            remaining--;
+                break;
         }
     }
     *dst = '\0';
 }
+
+void prompt_render(char *buf, size_t bufsize, const shell_config_t *config) {
+    render(buf, bufsize, config, 1);
+}
+
+void prompt_refresh(char *buf, size_t bufsize, const shell_config_t *config) {
+    render(buf, bufsize, config, 0);
+}
+
+int prompt_event_fd(void) {
+    return gitstatus_event_fd();
+}
+
+void prompt_event_clear(void) {
+    gitstatus_event_clear();
+}
+
+void prompt_free(void) {
+    gitstatus_free();
+}
@@ -0,0 +1,135 @@
+// src/script.c
+#define _GNU_SOURCE
+#include "script.h"
+#include "parser.h"
+#include "cmdcache.h"
+#include "executor.h"
+#include "builtins.h"
+#include "utils.h"
+#include "jobs.h"
+#include "metrics.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define SCRIPT_BUF_SIZE 65536
+
+typedef struct script_state {
+    const char *name;             // Script name for error messages
+    size_t line_no;
+    int status;                   // Exit status of the last command
+    int done;                     // Set once `exit` ran
+} script_state_t;
+
+// Parse and run one line; blank lines and # comments are skipped
+static void run_line(script_state_t *st, char *line) {
+    st->line_no++;
+    char *trimmed = trim_whitespace(line);
+    if (*trimmed == '\0' || *trimmed == '#') return;
+    TRACE(TRACE_LINE, (long long)strlen(trimmed), 0, trimmed);
+
+    struct timespec parse_start;
+    int timed = metrics_enabled();
+    if (timed) clock_gettime(CLOCK_MONOTONIC, &parse_start);
+    command_list_t *cmdlist = cmdcache_get(trimmed);
+    if (timed) metrics_record_parse(cmdlist, &parse_start);
+    if (!cmdlist) {
+        const char *reason = parse_error();
+        fprintf(stderr, "%s: line %zu: parse error%s%s\n", st->name, st->line_no, reason ? ": " : "",
+                reason ? reason : "");
+        st->status = 2;
+        return;
+    }
+
+    int exit_requested = 0;
+    int status = executor_run_list(cmdlist, &exit_requested);
+    if (exit_requested) {
+        int code = builtin_exit_code();
+        if (code >= 0) st->status = code;
+        st->done = 1;
+    } else {
+        st->status = status;
+    }
+    cmdcache_release(cmdlist);
+
+    // Background jobs are reaped between lines
+    jobs_reap();
+    jobs_notify();
+}
+
+int script_run_string(const char *text) {
+    script_state_t st = { .name = "-c" };
+    char *copy = strdup(text);
+    if (!copy) return 1;
+
+    char *line = copy;
+    while (line && !st.done) {
+        char *nl = strchr(line, '\n');
+        if (nl) *nl = '\0';
+        run_line(&st, line);
+        line = nl ? nl + 1 : NULL;
+    }
+    free(copy);
+    return st.status;
+}
+
+int script_run_file(const char *path) {
+    script_state_t st = { .name = path };
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "kali_shell: %s: %s\n", path, strerror(errno));
+        return 127;
+    }
+
+    // Lines are cut out of a refilled read buffer; only a line longer than
+    // the buffer makes it grow
+    size_t cap = SCRIPT_BUF_SIZE, start = 0, end = 0;
+    char *buf = malloc(cap + 1);
+    if (!buf) {
+        close(fd);
+        return 1;
+    }
+
+    while (!st.done) {
+        char *nl = memchr(buf + start, '\n', end - start);
+        if (nl) {
+            *nl = '\0';
+            run_line(&st, buf + start);
+            start = (size_t)(nl - buf) + 1;
+            continue;
+        }
+
+        if (start > 0) {
+            memmove(buf, buf + start, end - start);
+            end -= start;
+            start = 0;
+        }
+        if (end == cap) {
+            char *tmp = realloc(buf, cap * 2 + 1);
+            if (!tmp) break;
+            buf = tmp;
+            cap *= 2;
+        }
+
+        ssize_t n = read(fd, buf + end, cap - end);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) {
+            // Last line without a trailing newline
+            if (end > start) {
+                buf[end] = '\0';
+                run_line(&st, buf + start);
+            }
+            break;
+        }
+        end += (size_t)n;
+    }
+
+    free(buf);
+    close(fd);
+    return st.status;
+}
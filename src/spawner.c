@@ -0,0 +1,176 @@
+// src/spawner.c
+#define _GNU_SOURCE
+#include "spawner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+#if defined(_POSIX_SPAWN) && _POSIX_SPAWN > 0
+static spawn_engine_t engine = SPAWN_ENGINE_POSIX;
+#else
+static spawn_engine_t engine = SPAWN_ENGINE_FORK;
+#endif
+
+void spawn_set_engine(spawn_engine_t e) {
+    engine = e;
+}
+
+spawn_engine_t spawn_get_engine(void) {
+    return engine;
+}
+
+// Signals the shell may handle or ignore that children must see as default
+static void default_signals(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGQUIT);
+    sigaddset(set, SIGTSTP);
+    sigaddset(set, SIGTTIN);
+    sigaddset(set, SIGTTOU);
+    sigaddset(set, SIGCHLD);
+    sigaddset(set, SIGPIPE);
+}
+
+#if defined(_POSIX_SPAWN) && _POSIX_SPAWN > 0
+static int spawn_posix(const spawn_req_t *req, pid_t *pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int err;
+
+    if ((err = posix_spawn_file_actions_init(&actions)) != 0)
+        return err;
+    if ((err = posix_spawnattr_init(&attr)) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
+    }
+
+    // The terminal is taken before stdin is replaced; signals stay blocked
+    // in the child until exec, so tcsetpgrp() cannot raise SIGTTOU
+    if (req->take_terminal)
+        err = posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+
+    // The source fds are close-on-exec, so only the dup'ed copies survive
+    if (!err && req->stdin_fd != -1)
+        err = posix_spawn_file_actions_adddup2(&actions, req->stdin_fd, STDIN_FILENO);
+    if (!err && req->stdout_fd != -1)
+        err = posix_spawn_file_actions_adddup2(&actions, req->stdout_fd, STDOUT_FILENO);
+    if (!err && req->stderr_fd != -1)
+        err = posix_spawn_file_actions_adddup2(&actions, req->stderr_fd, STDERR_FILENO);
+    else if (!err && req->stderr_to_stdout)
+        err = posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+    sigset_t none, defaults;
+    sigemptyset(&none);
+    default_signals(&defaults);
+    if (!err) err = posix_spawnattr_setsigmask(&attr, &none);
+    if (!err) err = posix_spawnattr_setsigdefault(&attr, &defaults);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (req->setpgroup) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        if (!err) err = posix_spawnattr_setpgroup(&attr, req->pgid);
+    }
+    if (!err) err = posix_spawnattr_setflags(&attr, flags);
+
+    if (!err) {
+        if (req->path)
+            err = posix_spawn(pid, req->path, &actions, &attr, req->argv, environ);
+        else
+            err = posix_spawnp(pid, req->argv[0], &actions, &attr, req->argv, environ);
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
+}
+#endif
+
+// fork()+exec fallback. Exec failures are reported back to the parent over a
+// close-on-exec pipe so both engines surface errors the same way.
+static int spawn_fork(const spawn_req_t *req, pid_t *pid) {
+    int errpipe[2];
+    if (pipe2(errpipe, O_CLOEXEC) == -1)
+        return errno;
+
+    pid_t child = fork();
+    if (child == -1) {
+        int err = errno;
+        close(errpipe[0]);
+        close(errpipe[1]);
+        return err;
+    }
+
+    if (child == 0) {
+        // The shell ignores SIGTTOU, so this runs before signals are reset
+        if (req->setpgroup && setpgid(0, req->pgid) == -1)
+            goto fail;
+        if (req->take_terminal && tcsetpgrp(STDIN_FILENO, getpgrp()) == -1)
+            goto fail;
+
+        sigset_t none, defaults;
+        sigemptyset(&none);
+        default_signals(&defaults);
+        for (int sig = 1; sig < NSIG; sig++) {
+            if (sigismember(&defaults, sig) == 1)
+                signal(sig, SIG_DFL);
+        }
+        sigprocmask(SIG_SETMASK, &none, NULL);
+
+        if (req->stdin_fd != -1 && dup2(req->stdin_fd, STDIN_FILENO) == -1)
+            goto fail;
+        if (req->stdout_fd != -1 && dup2(req->stdout_fd, STDOUT_FILENO) == -1)
+            goto fail;
+        if (req->stderr_fd != -1) {
+            if (dup2(req->stderr_fd, STDERR_FILENO) == -1)
+                goto fail;
+        } else if (req->stderr_to_stdout && dup2(STDOUT_FILENO, STDERR_FILENO) == -1) {
+            goto fail;
+        }
+
+        if (req->path)
+            execv(req->path, req->argv);
+        else
+            execvp(req->argv[0], req->argv);
+fail:;
+        int err = errno;
+        ssize_t n = write(errpipe[1], &err, sizeof(err));
+        (void)n;
+        _exit(127);
+    }
+
+    close(errpipe[1]);
+    int child_err = 0;
+    ssize_t n;
+    do {
+        n = read(errpipe[0], &child_err, sizeof(child_err));
+    } while (n == -1 && errno == EINTR);
+    close(errpipe[0]);
+
+    if (n == (ssize_t)sizeof(child_err)) {
+        waitpid(child, NULL, 0);
+        return child_err;
+    }
+
+    *pid = child;
+    return 0;
+}
+
+int spawn_process(const spawn_req_t *req, pid_t *pid) {
+    if (!req || !req->argv || !req->argv[0] || !pid)
+        return EINVAL;
+
+#if defined(_POSIX_SPAWN) && _POSIX_SPAWN > 0
+    if (engine == SPAWN_ENGINE_POSIX) {
+        int err = spawn_posix(req, pid);
+        if (err != ENOSYS)
+            return err;
+    }
+#endif
+    return spawn_fork(req, pid);
+}
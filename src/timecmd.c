@@ -0,0 +1,188 @@
+// src/timecmd.c
+#define _GNU_SOURCE
+#include "timecmd.h"
+#include "jobs.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Summed over the stages; maxrss is the largest stage's, as the stages
+// do not necessarily peak together
+typedef struct usage_row {
+    double real;
+    double user;
+    double sys;
+    long maxrss;                  // KiB
+    long majflt;
+    long minflt;
+    long nvcsw;
+    long nivcsw;
+} usage_row_t;
+
+static double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void row_from_rusage(usage_row_t *row, double real, const struct rusage *ru) {
+    row->real = real;
+    row->user = seconds(ru->ru_utime);
+    row->sys = seconds(ru->ru_stime);
+    row->maxrss = ru->ru_maxrss;
+    row->majflt = ru->ru_majflt;
+    row->minflt = ru->ru_minflt;
+    row->nvcsw = ru->ru_nvcsw;
+    row->nivcsw = ru->ru_nivcsw;
+}
+
+static void row_add(usage_row_t *total, const usage_row_t *row) {
+    total->user += row->user;
+    total->sys += row->sys;
+    if (row->maxrss > total->maxrss) total->maxrss = row->maxrss;
+    total->majflt += row->majflt;
+    total->minflt += row->minflt;
+    total->nvcsw += row->nvcsw;
+    total->nivcsw += row->nivcsw;
+}
+
+int timecmd_is_time(const command_t *cmd) {
+    return cmd && cmd->argc > 0 && strcmp(cmd->argv[0], "time") == 0;
+}
+
+int timecmd_begin(timecmd_t *t, const command_t *head, command_t *stripped) {
+    memset(t, 0, sizeof(*t));
+    int i = 1;
+    for (; i < head->argc && head->argv[i][0] == '-'; i++) {
+        if (strcmp(head->argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(head->argv[i], "-j") != 0) {
+            fprintf(stderr, "time: %s: invalid option\nusage: time [-j] pipeline\n", head->argv[i]);
+            return -1;
+        }
+        t->json = 1;
+    }
+
+    // Redirections and later stages stay with the stripped head
+    *stripped = *head;
+    stripped->argv = head->argv + i;
+    stripped->argc = head->argc - i;
+    stripped->path = NULL;
+
+    getrusage(RUSAGE_SELF, &t->self);
+    clock_gettime(CLOCK_MONOTONIC, &t->started);
+    return 0;
+}
+
+static void format_kib(char *buf, size_t size, long kib) {
+    if (kib < 1024)
+        snprintf(buf, size, "%ldK", kib);
+    else if (kib < 1024 * 1024)
+        snprintf(buf, size, "%.1fM", kib / 1024.0);
+    else
+        snprintf(buf, size, "%.2fG", kib / (1024.0 * 1024.0));
+}
+
+static void print_row(const char *label, const usage_row_t *row, int has_real, const char *command) {
+    char real[32], rss[32];
+    if (has_real)
+        snprintf(real, sizeof(real), "%.3fs", row->real);
+    else
+        snprintf(real, sizeof(real), "-");
+    format_kib(rss, sizeof(rss), row->maxrss);
+    fprintf(stderr, "%-6s %9s %9.3fs %9.3fs %8s %7ld %8ld %7ld %7ld  %s\n", label, real, row->user,
+            row->sys, rss, row->majflt, row->minflt, row->nvcsw, row->nivcsw, command ? command : "");
+}
+
+// A stage's words, for the report; raw text would still carry `time -j`
+static void stage_text(char *buf, size_t size, const command_t *cmd) {
+    size_t used = 0;
+    buf[0] = '\0';
+    for (int i = 0; cmd && i < cmd->argc && used < size; i++)
+        used += (size_t)snprintf(buf + used, size - used, "%s%s", i ? " " : "", cmd->argv[i]);
+}
+
+static void json_string(const char *s) {
+    fputc('"', stderr);
+    for (; s && *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(stderr, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(stderr, "\\u%04x", c);
+        else
+            fputc(c, stderr);
+    }
+    fputc('"', stderr);
+}
+
+// stage: 1-based, 0 for the shell's own row, -1 for the total
+static void print_json(int stage, pid_t pid, const char *command, int status, const usage_row_t *row) {
+    if (stage > 0)
+        fprintf(stderr, "{\"stage\":%d,\"pid\":%d,\"command\":", stage, (int)pid);
+    else
+        fprintf(stderr, "{\"stage\":\"%s\",\"command\":", stage == 0 ? "shell" : "total");
+    json_string(command);
+    fprintf(stderr,
+            ",\"status\":%d,\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,"
+            "\"majflt\":%ld,\"minflt\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld}\n",
+            status, row->real, row->user, row->sys, row->maxrss, row->majflt, row->minflt,
+            row->nvcsw, row->nivcsw);
+}
+
+void timecmd_end(timecmd_t *t, const command_t *stripped, int ran_job, int status) {
+    struct timespec now;
+    struct rusage self;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &self);
+
+    usage_row_t total = { 0 };
+    total.real = (now.tv_sec - t->started.tv_sec) + (now.tv_nsec - t->started.tv_nsec) / 1e9;
+
+    // The shell's share: builtins and in-shell stages (cat, tee, parallel)
+    usage_row_t shell = { 0 };
+    shell.user = seconds(self.ru_utime) - seconds(t->self.ru_utime);
+    shell.sys = seconds(self.ru_stime) - seconds(t->self.ru_stime);
+    shell.majflt = self.ru_majflt - t->self.ru_majflt;
+    shell.minflt = self.ru_minflt - t->self.ru_minflt;
+    shell.nvcsw = self.ru_nvcsw - t->self.ru_nvcsw;
+    shell.nivcsw = self.ru_nivcsw - t->self.ru_nivcsw;
+
+    const process_t *procs = NULL;
+    size_t nprocs = ran_job ? jobs_last_procs(&procs) : 0;
+    int in_shell = (nprocs == 0);
+
+    if (!t->json) {
+        fprintf(stderr, "%-6s %9s %10s %10s %8s %7s %8s %7s %7s  %s\n", "stage", "real", "user", "sys",
+                "maxrss", "majflt", "minflt", "vcsw", "ivcsw", "command");
+    }
+    const command_t *c = stripped;
+    for (size_t i = 0; i < nprocs; i++, c = c ? c->pipe_to : NULL) {
+        if (procs[i].pid == 0) {
+            in_shell = 1;
+            continue;
+        }
+        char text[256];
+        stage_text(text, sizeof(text), c);
+        usage_row_t row;
+        row_from_rusage(&row, procs[i].real, &procs[i].usage);
+        row_add(&total, &row);
+        if (t->json) {
+            print_json((int)i + 1, procs[i].pid, text, procs[i].status, &row);
+        } else {
+            char label[24];
+            snprintf(label, sizeof(label), "%zu", i + 1);
+            print_row(label, &row, 1, text);
+        }
+    }
+    if (in_shell) {
+        row_add(&total, &shell);
+        if (t->json)
+            print_json(0, 0, "", status, &shell);
+        else
+            print_row("shell", &shell, 0, "(builtins and in-shell stages)");
+    }
+    if (t->json)
+        print_json(-1, 0, "", status, &total);
+    else
+        print_row("total", &total, 1, "");
+}
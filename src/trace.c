@@ -0,0 +1,210 @@
+// src/trace.c
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#define TRACE_TEXT_MAX 48         // Longer text is cut
+#define TRACE_JSON_MAX 256        // One formatted event
+
+typedef struct trace_event {
+    unsigned long long seq;       // Event number + 1 once the slot is complete, 0 while written
+    long long ns;                 // CLOCK_MONOTONIC
+    long long a;
+    long long b;
+    trace_kind_t kind;
+    char text[TRACE_TEXT_MAX];
+} trace_event_t;
+
+int trace_active = 0;
+
+static trace_event_t ring[TRACE_RING_SIZE];
+static unsigned long long recorded = 0;  // Events ever recorded; the next slot (atomic)
+static int stream_fd = -1;
+static const char *stream_path = NULL;
+
+// Event name and the names of its a and b fields (NULL: not written)
+static const struct {
+    const char *name;
+    const char *a;
+    const char *b;
+} kinds[TRACE_KIND_COUNT] = {
+    [TRACE_LINE] = { "line", "len", NULL },
+    [TRACE_ALIAS] = { "alias", "stages", NULL },
+    [TRACE_PARSE] = { "parse", "pipelines", "ns" },
+    [TRACE_CACHE_HIT] = { "cache_hit", "pipelines", "ns" },
+    [TRACE_OPEN] = { "open", "fd", "errno" },
+    [TRACE_PIPE] = { "pipe", "read_fd", "write_fd" },
+    [TRACE_DUP2] = { "dup2", "from", "to" },
+    [TRACE_SPAWN] = { "spawn", "pid", "errno" },
+    [TRACE_WAIT] = { "wait", "pid", "status" },
+    [TRACE_SIGNAL] = { "signal", "signo", "count" },
+};
+
+long long trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Append s as a JSON string; stops short of the end of buf
+static size_t put_string(char *buf, size_t used, size_t size, const char *s) {
+    if (used < size) buf[used++] = '"';
+    for (; *s && used + 7 < size; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            buf[used++] = '\\';
+            buf[used++] = (char)c;
+        } else if (c < 0x20) {
+            used += (size_t)snprintf(buf + used, size - used, "\\u%04x", c);
+        } else {
+            buf[used++] = (char)c;
+        }
+    }
+    if (used < size) buf[used++] = '"';
+    return used;
+}
+
+// One JSON line for e, newline included; returns its length
+static size_t format_event(char *buf, size_t size, const trace_event_t *e) {
+    size_t used = (size_t)snprintf(buf, size, "{\"ts\":%lld.%09lld,\"ev\":\"%s\"", e->ns / 1000000000LL,
+                                   e->ns % 1000000000LL, kinds[e->kind].name);
+    if (kinds[e->kind].a && used < size)
+        used += (size_t)snprintf(buf + used, size - used, ",\"%s\":%lld", kinds[e->kind].a, e->a);
+    if (kinds[e->kind].b && used < size)
+        used += (size_t)snprintf(buf + used, size - used, ",\"%s\":%lld", kinds[e->kind].b, e->b);
+    if (e->text[0] && used + 16 < size) {
+        memcpy(buf + used, ",\"text\":", 8);
+        used = put_string(buf, used + 8, size - 3, e->text);
+    }
+    if (used > size - 3) used = size - 3;
+    buf[used++] = '}';
+    buf[used++] = '\n';
+    buf[used] = '\0';
+    return used;
+}
+
+// Copy event n out of the ring. Returns 0 if its slot is being written
+// or already holds a later event.
+static int read_event(unsigned long long n, trace_event_t *out) {
+    trace_event_t *e = &ring[n % TRACE_RING_SIZE];
+    unsigned long long seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+    if (seq != n + 1) return 0;
+    memcpy(out, e, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq;
+}
+
+void trace_record(trace_kind_t kind, long long a, long long b, const char *text) {
+    trace_event_t ev;
+    ev.ns = trace_now();
+    ev.kind = kind;
+    ev.a = a;
+    ev.b = b;
+    if (text) {
+        size_t len = strnlen(text, TRACE_TEXT_MAX - 1);
+        memcpy(ev.text, text, len);
+        ev.text[len] = '\0';
+    } else {
+        ev.text[0] = '\0';
+    }
+
+    // Any thread may record; each caller gets its own slot, published by
+    // its seq so that a reader skips a slot still being written
+    unsigned long long n = __atomic_fetch_add(&recorded, 1, __ATOMIC_RELAXED);
+    trace_event_t *e = &ring[n % TRACE_RING_SIZE];
+    ev.seq = n + 1;
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->ns = ev.ns;
+    e->kind = ev.kind;
+    e->a = ev.a;
+    e->b = ev.b;
+    memcpy(e->text, ev.text, sizeof(ev.text));
+    __atomic_store_n(&e->seq, ev.seq, __ATOMIC_RELEASE);
+
+    if (stream_fd != -1) {
+        char line[TRACE_JSON_MAX];
+        size_t len = format_event(line, sizeof(line), &ev);
+        // A single write per event keeps lines whole in an O_APPEND file
+        if (write(stream_fd, line, len) == -1 && errno != EINTR) {
+            close(stream_fd);
+            stream_fd = -1;
+        }
+    }
+}
+
+void trace_init(void) {
+    const char *path = getenv("KALI_SHELL_TRACE");
+    if (!path || !*path) return;
+
+    if (strcmp(path, "-") == 0) {
+        stream_fd = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 10);
+    } else {
+        stream_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    if (stream_fd == -1) {
+        fprintf(stderr, "KALI_SHELL_TRACE: %s: %s\n", path, strerror(errno));
+        return;
+    }
+    stream_path = path;
+    trace_active = 1;
+}
+
+void trace_start(void) {
+    trace_active = 1;
+}
+
+void trace_stop(void) {
+    trace_active = 0;
+}
+
+void trace_clear(void) {
+    __atomic_store_n(&recorded, 0, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < TRACE_RING_SIZE; i++) __atomic_store_n(&ring[i].seq, 0, __ATOMIC_RELAXED);
+}
+
+int trace_dump(const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    unsigned long long last = __atomic_load_n(&recorded, __ATOMIC_RELAXED);
+    unsigned long long first = last > TRACE_RING_SIZE ? last - TRACE_RING_SIZE : 0;
+    char line[TRACE_JSON_MAX];
+    trace_event_t ev;
+    for (unsigned long long n = first; n < last; n++) {
+        if (!read_event(n, &ev)) continue;
+        size_t len = format_event(line, sizeof(line), &ev);
+        fwrite(line, 1, len, f);
+    }
+    if (f == stdout) {
+        fflush(f);
+        return 0;
+    }
+    if (fclose(f) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+void trace_print(void) {
+    unsigned long long count = __atomic_load_n(&recorded, __ATOMIC_RELAXED);
+    unsigned long long kept = count < TRACE_RING_SIZE ? count : TRACE_RING_SIZE;
+    printf("trace: %s, %llu events recorded, %llu kept (ring of %d)\n", trace_active ? "on" : "off",
+           count, kept, TRACE_RING_SIZE);
+    if (stream_fd != -1) printf("streaming to %s\n", strcmp(stream_path, "-") == 0 ? "stderr" : stream_path);
+}
+
+void trace_free(void) {
+    trace_active = 0;
+    if (stream_fd != -1) close(stream_fd);
+    stream_fd = -1;
+}